@@ -0,0 +1,338 @@
+/**
+ * This file contains benchmarks for the hot paths of the interrupt simulator.
+ * Workloads are generated in process with the same distributions as generateInput.py.
+ * @date September 30th, 2024
+ * @author John Khalife, Stavros Karamalis
+ */
+
+#include <iostream>
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <deque>
+#include <filesystem>
+#include <unordered_set>
+#include <unistd.h>
+
+#include "interrupts_internal.hpp"
+
+using namespace std;
+
+namespace Execution
+{
+    //This class times the parts of the simulator that run once per event.
+    //The simulator is driven through its public interface. The policies, scheduling queue and memory are timed on their
+    //own, so those come from the internal header.
+    class Benchmark {
+    public:
+        //This structure is the result of a single benchmark
+        struct Result {
+            std::string name;
+            size_t processes;
+            unsigned long events;
+            double seconds;
+        };
+
+        /**
+         * This constructor prepares a directory for the generated workloads and output files
+         * @param repeats - how many times each benchmark runs, the fastest run is reported
+        */
+        Benchmark(int repeats);
+        ~Benchmark();
+
+        /**
+         * This method runs every benchmark whose name contains the filter for a workload size
+         * @param processes - the number of processes in the workload
+         * @param filter - only benchmarks containing this are run, empty for all of them
+        */
+        void runAll(size_t processes, std::string filter);
+
+    private:
+        int repeats;
+        std::filesystem::path directory; //where workloads and output files are written
+
+        /**
+         * This method generates a workload the way generateInput.py does. Arrivals are spread over a window
+         * that grows with the number of processes so that the load stays about the same at every size.
+         * @param processes - the number of processes
+         * @param seed - the seed of the random numbers
+         * @return the pcb table
+        */
+        std::vector<pcb_t> generate(size_t processes, unsigned seed);
+
+        /**
+         * This method returns the options for a simulation of the given workload
+         * @param workload - the workload file
+         * @param strategy - the strategy
+         * @return the options
+        */
+        Parsing::Options optionsFor(std::string workload, std::string strategy);
+
+        //Each of these returns the number of events handled and sets the time they took.
+        //For arrivals and IO an event is a tick, since both are checked once every tick.
+        unsigned long loadText(size_t processes, double& seconds);
+        unsigned long loadBinary(size_t processes, double& seconds);
+        unsigned long schedule(size_t processes, std::string strategy, double& seconds);
+        unsigned long reserve(size_t processes, MemoryMode mode, double& seconds);
+        unsigned long arrivalsAndIO(size_t processes, double& seconds);
+        unsigned long endToEnd(size_t processes, std::string strategy, bool eventDriven, double& seconds);
+
+        /**
+         * This method runs a benchmark as many times as asked and prints the fastest run
+         * @param name - the name of the benchmark
+         * @param processes - the number of processes in the workload
+         * @param run - runs the benchmark once
+        */
+        template <typename Run>
+        void measure(std::string name, size_t processes, Run run);
+
+        std::string workloadFile(size_t processes, bool binary);
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    static double secondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    Benchmark::Benchmark(int repeats) : repeats(repeats)
+    {
+        directory = filesystem::temp_directory_path() / ("sim_benchmark_" + to_string(getpid()));
+        filesystem::create_directories(directory);
+    }
+
+    Benchmark::~Benchmark()
+    {
+        filesystem::remove_all(directory);
+    }
+
+    vector<pcb_t> Benchmark::generate(size_t processes, unsigned seed)
+    {
+        mt19937 rng(seed);
+        auto between = [&](uint low, uint high) { return uniform_int_distribution<uint>(low, high)(rng); };
+        uint arrivalWindow = max<size_t>(100, processes * 100);
+        unordered_set<uint> pids;
+        pids.reserve(processes);
+        vector<pcb_t> pcbTable(processes);
+        for (pcb_t& p : pcbTable) {
+            do {
+                p.pid = between(0, 100 * processes);
+            } while (!pids.insert(p.pid).second);
+            p.memorySize = between(1, 40);
+            p.arrivalTime = between(0, arrivalWindow);
+            p.totalCPUTime = between(1, 40);
+            p.ioFrequency = between(1, 20);
+            p.ioDuration = between(1, 20);
+        }
+        return pcbTable;
+    }
+
+    string Benchmark::workloadFile(size_t processes, bool binary)
+    {
+        string fileName = (directory / ("input_data_" + to_string(processes) + (binary ? ".bin" : ".txt"))).string();
+        if (!filesystem::exists(fileName)) {
+            vector<pcb_t> pcbTable = generate(processes, processes);
+            if (binary) {
+                Parsing::writeBinaryWorkload(pcbTable, fileName);
+            } else {
+                Parsing::writeTextWorkload(pcbTable, fileName);
+            }
+        }
+        return fileName;
+    }
+
+    Parsing::Options Benchmark::optionsFor(string workload, string strategy)
+    {
+        Parsing::Options options;
+        options.inputFile = workload;
+        options.strategy = strategy;
+        options.partitionSizes.assign(PARTITION_SIZES, PARTITION_SIZES + PARTITION_NUM);
+        return options;
+    }
+
+    unsigned long Benchmark::loadText(size_t processes, double& seconds)
+    {
+        string fileName = workloadFile(processes, false);
+        Clock::time_point start = Clock::now();
+        vector<pcb_t> pcbTable = Parsing::loadPCBTable(fileName);
+        seconds = secondsSince(start);
+        return pcbTable.size();
+    }
+
+    unsigned long Benchmark::loadBinary(size_t processes, double& seconds)
+    {
+        string fileName = workloadFile(processes, true);
+        Clock::time_point start = Clock::now();
+        vector<pcb_t> pcbTable = Parsing::loadPCBTable(fileName);
+        seconds = secondsSince(start);
+        return pcbTable.size();
+    }
+
+    unsigned long Benchmark::schedule(size_t processes, string strategy, double& seconds)
+    {
+        withPolicy(strategy, [&](auto tag) {
+            typename decltype(tag)::type policy;
+            vector<pcb_t> pcbTable = Parsing::loadPCBTable(workloadFile(processes, true));
+            policy.configure(optionsFor(workloadFile(processes, true), strategy));
+            SchedulingQueue queue;
+            unsigned long ticket = 1;
+            for (pcb_t& p : pcbTable) {
+                queue.push({policy.key(&p, READY), ticket++, &p});
+            }
+            //Every pick runs a whole slice and sends the process back to the ready queue, so the queue stays full
+            Clock::time_point start = Clock::now();
+            for (size_t i = 0; i < processes; i++) {
+                pcb_t* process = queue.top().process;
+                queue.pop();
+                policy.burstEnded(process, policy.slice(process, queue.size() + 1), true);
+                queue.push({policy.key(process, READY), ticket++, process});
+            }
+            seconds = secondsSince(start);
+        });
+        return processes;
+    }
+
+    unsigned long Benchmark::reserve(size_t processes, MemoryMode mode, double& seconds)
+    {
+        vector<pcb_t> pcbTable = Parsing::loadPCBTable(workloadFile(processes, true));
+        vector<uint> sizes(PARTITION_SIZES, PARTITION_SIZES + PARTITION_NUM);
+        unique_ptr<Memory> memory((mode == FIXED) ? new Memory(sizes) : new Memory(mode, 1 << 14));
+        //Allocate every process in turn, freeing the oldest allocations whenever memory runs out
+        deque<Partition*> allocated;
+        unsigned long operations = 0;
+        Clock::time_point start = Clock::now();
+        for (pcb_t& p : pcbTable) {
+            Partition* partition;
+            while ((partition = memory->allocate(p.memorySize, p.pid)) == nullptr && !allocated.empty()) {
+                memory->release(allocated.front());
+                allocated.pop_front();
+                operations++;
+            }
+            if (partition != nullptr) {
+                allocated.push_back(partition);
+            }
+            operations++;
+        }
+        seconds = secondsSince(start);
+        return operations;
+    }
+
+    unsigned long Benchmark::arrivalsAndIO(size_t processes, double& seconds)
+    {
+        //Memory is big enough for everyone and every process runs for a tick, does IO once and runs for another tick,
+        //so nearly every tick is spent checking for arrivals and finished IO
+        vector<pcb_t> pcbTable = Parsing::loadPCBTable(workloadFile(processes, true));
+        for (pcb_t& p : pcbTable) {
+            p.totalCPUTime = 2;
+            p.ioFrequency = 1;
+        }
+        Parsing::Options options = optionsFor(workloadFile(processes, true), "FCFS");
+        options.memoryMode = FIRST_FIT;
+        options.memorySize = processes * 40;
+        Simulator<Policies::FCFS> simulator(options, move(pcbTable), directory.string());
+        simulator.setVerbose(false);
+        Clock::time_point start = Clock::now();
+        while (simulator.step()) {}
+        seconds = secondsSince(start);
+        simulator.finish();
+        return simulator.time();
+    }
+
+    unsigned long Benchmark::endToEnd(size_t processes, string strategy, bool eventDriven, double& seconds)
+    {
+        Parsing::Options options = optionsFor(workloadFile(processes, true), strategy);
+        options.eventDriven = eventDriven;
+        unsigned long transitions = 0;
+        withPolicy(strategy, [&](auto policy) {
+            Clock::time_point start = Clock::now();
+            Simulator<typename decltype(policy)::type> simulator(options, directory.string());
+            simulator.setVerbose(false);
+            simulator.run();
+            seconds = secondsSince(start);
+            transitions = simulator.metrics().transitions();
+        });
+        return transitions;
+    }
+
+    template <typename Run>
+    void Benchmark::measure(string name, size_t processes, Run run)
+    {
+        Result best = {name, processes, 0, 0};
+        for (int i = 0; i < repeats; i++) {
+            double seconds = 0;
+            unsigned long events = run(seconds);
+            if (i == 0 || seconds < best.seconds) {
+                best.events = events;
+                best.seconds = seconds;
+            }
+        }
+        double nsPerEvent = (best.events == 0) ? 0 : best.seconds * 1e9 / best.events;
+        double eventsPerSecond = (best.seconds == 0) ? 0 : best.events / best.seconds;
+        printf("%-24s %10zu %12lu %12.6f %12.1f %14.0f\n", best.name.c_str(), best.processes, best.events, best.seconds, nsPerEvent, eventsPerSecond);
+        fflush(stdout);
+    }
+
+    void Benchmark::runAll(size_t processes, string filter)
+    {
+        auto wanted = [&](const string& name) { return filter.empty() || name.find(filter) != string::npos; };
+        if (wanted("load_text")) {
+            measure("load_text", processes, [&](double& s) { return loadText(processes, s); });
+        }
+        if (wanted("load_binary")) {
+            measure("load_binary", processes, [&](double& s) { return loadBinary(processes, s); });
+        }
+        for (string strategy : {"FCFS", "EP", "RR", "SJF", "SRTF", "MLFQ", "CFS"}) {
+            if (wanted("schedule_" + strategy)) {
+                measure("schedule_" + strategy, processes, [&](double& s) { return schedule(processes, strategy, s); });
+            }
+        }
+        const pair<const char*, MemoryMode> modes[] = {{"fixed", FIXED}, {"first_fit", FIRST_FIT}, {"next_fit", NEXT_FIT}, {"best_fit", BEST_FIT}, {"buddy", BUDDY}};
+        for (auto& [modeName, mode] : modes) {
+            string name = string("reserve_") + modeName;
+            if (wanted(name)) {
+                measure(name, processes, [&](double& s) { return reserve(processes, mode, s); });
+            }
+        }
+        if (wanted("arrivals_io")) {
+            measure("arrivals_io", processes, [&](double& s) { return arrivalsAndIO(processes, s); });
+        }
+        for (string strategy : {"FCFS", "EP", "RR", "SJF", "SRTF", "MLFQ", "CFS"}) {
+            for (bool eventDriven : {false, true}) {
+                string name = "end_to_end_" + strategy + (eventDriven ? "_event" : "_tick");
+                if (wanted(name)) {
+                    measure(name, processes, [&](double& s) { return endToEnd(processes, strategy, eventDriven, s); });
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    vector<size_t> sizes = {1000, 10000, 100000, 1000000};
+    int repeats = 3;
+    string filter;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg.rfind("--sizes=", 0) == 0) {
+            sizes.clear();
+            for (uint size : Parsing::parsePartitionSizes(arg.substr(arg.find('=') + 1))) {
+                sizes.push_back(size);
+            }
+        } else if (arg.rfind("--repeat=", 0) == 0) {
+            repeats = max(1, stoi(arg.substr(arg.find('=') + 1)));
+        } else if (arg.rfind("--filter=", 0) == 0) {
+            filter = arg.substr(arg.find('=') + 1);
+        } else {
+            cout << "Usage: " << argv[0] << " [--sizes=1000,10000,...] [--repeat=N] [--filter=name]" << endl;
+            return 1;
+        }
+    }
+    Execution::Benchmark benchmark(repeats);
+    printf("%-24s %10s %12s %12s %12s %14s\n", "benchmark", "processes", "events", "seconds", "ns/event", "events/sec");
+    for (size_t processes : sizes) {
+        benchmark.runAll(processes, filter);
+    }
+    return 0;
+}
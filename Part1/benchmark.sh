@@ -0,0 +1,4 @@
+#compile and run the benchmarks against the simulator library, any arguments are passed on (--sizes=, --repeat=, --filter=)
+bash buildLibrary.sh
+g++ -O2 benchmark.cpp libsim.a -o benchmark
+./benchmark "$@"
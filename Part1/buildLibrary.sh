@@ -0,0 +1,4 @@
+#compile the simulator without its main into a static library, a harness links it with: g++ harness.cpp libsim.a -o harness
+g++ -O2 -c -DSIM_NO_MAIN interrupts.cpp -o interrupts.o
+ar rcs libsim.a interrupts.o
+rm interrupts.o
@@ -16,485 +16,4036 @@
 #include <cstdint>
 #include <deque>
 #include <algorithm>
+#include <numeric>
+#include <climits>
+#include <cmath>
+#include <charconv>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
-#include "interrupts.hpp"
+#include "interrupts_internal.hpp"
 
 using namespace std;
 
+namespace MemoryStructures
+{
+    void StateQueue::push_back(pcb_t* process) {
+        process->prev = tail;
+        process->next = nullptr;
+        if (tail != nullptr) {
+            tail->next = process;
+        } else {
+            head = process;
+        }
+        tail = process;
+        count++;
+    }
+
+    void StateQueue::push_front(pcb_t* process) {
+        process->prev = nullptr;
+        process->next = head;
+        if (head != nullptr) {
+            head->prev = process;
+        } else {
+            tail = process;
+        }
+        head = process;
+        count++;
+    }
+
+    void StateQueue::remove(pcb_t* process) {
+        if (process->prev != nullptr) {
+            process->prev->next = process->next;
+        } else {
+            head = process->next;
+        }
+        if (process->next != nullptr) {
+            process->next->prev = process->prev;
+        } else {
+            tail = process->prev;
+        }
+        process->prev = nullptr;
+        process->next = nullptr;
+        count--;
+    }
+
+    //These helpers keep the free list treap ordered by address and its largest hole counts up to date
+    static uint largestOf(FreeList::Node* node) {
+        return (node == nullptr) ? 0 : node->largest;
+    }
+
+    static void update(FreeList::Node* node) {
+        node->largest = max(node->size, max(largestOf(node->left), largestOf(node->right)));
+    }
+
+    //Splits a treap into the holes below an address and the holes at or above it
+    static void split(FreeList::Node* node, uint address, FreeList::Node*& below, FreeList::Node*& above) {
+        if (node == nullptr) {
+            below = above = nullptr;
+            return;
+        }
+        if (node->start < address) {
+            split(node->right, address, node->right, above);
+            below = node;
+        } else {
+            split(node->left, address, below, node->left);
+            above = node;
+        }
+        update(node);
+    }
+
+    //Joins two treaps, every hole in below must come before every hole in above
+    static FreeList::Node* merge(FreeList::Node* below, FreeList::Node* above) {
+        if (below == nullptr) {
+            return above;
+        }
+        if (above == nullptr) {
+            return below;
+        }
+        if (below->priority > above->priority) {
+            below->right = merge(below->right, above);
+            update(below);
+            return below;
+        }
+        above->left = merge(below, above->left);
+        update(above);
+        return above;
+    }
+
+    static void destroy(FreeList::Node* node) {
+        if (node != nullptr) {
+            destroy(node->left);
+            destroy(node->right);
+            delete node;
+        }
+    }
+
+    static FreeList::Node* firstFitIn(FreeList::Node* node, uint size, uint from) {
+        if (node == nullptr || node->largest < size) {
+            return nullptr;
+        }
+        if (node->start >= from) {
+            FreeList::Node* found = firstFitIn(node->left, size, from);
+            if (found != nullptr) {
+                return found;
+            }
+            if (node->size >= size) {
+                return node;
+            }
+        }
+        return firstFitIn(node->right, size, from);
+    }
+
+    FreeList::~FreeList() {
+        destroy(root);
+    }
+
+    FreeList::FreeList(FreeList&& other) : root(other.root), bySize(std::move(other.bySize)) {
+        other.root = nullptr;
+        other.bySize.clear();
+    }
+
+    FreeList& FreeList::operator=(FreeList&& other) {
+        if (this != &other) {
+            destroy(root);
+            root = other.root;
+            bySize = std::move(other.bySize);
+            other.root = nullptr;
+            other.bySize.clear();
+        }
+        return *this;
+    }
+
+    void FreeList::insert(uint start, uint size) {
+        //The priority only has to look random, hashing the address keeps runs reproducible
+        FreeList::Node* node = new FreeList::Node{start, size, size, start * 2654435761u, nullptr, nullptr};
+        FreeList::Node *below, *above;
+        split(root, start, below, above);
+        root = merge(merge(below, node), above);
+        bySize.insert({size, start});
+    }
+
+    void FreeList::erase(uint start) {
+        FreeList::Node *below, *middle, *above;
+        split(root, start, below, middle);
+        split(middle, start + 1, middle, above);
+        if (middle != nullptr) {
+            bySize.erase({middle->size, start});
+            delete middle;
+        }
+        root = merge(below, above);
+    }
+
+    FreeList::Node* FreeList::firstFit(uint size, uint from) const {
+        return firstFitIn(root, size, from);
+    }
+
+    FreeList::Node* FreeList::bestFit(uint size) const {
+        auto best = bySize.lower_bound({size, 0});
+        return (best == bySize.end()) ? nullptr : at(best->second);
+    }
+
+    FreeList::Node* FreeList::before(uint address) const {
+        FreeList::Node* found = nullptr;
+        for (FreeList::Node* node = root; node != nullptr; ) {
+            if (node->start < address) {
+                found = node;
+                node = node->right;
+            } else {
+                node = node->left;
+            }
+        }
+        return found;
+    }
+
+    FreeList::Node* FreeList::at(uint address) const {
+        for (FreeList::Node* node = root; node != nullptr; ) {
+            if (node->start == address) {
+                return node;
+            }
+            node = (address < node->start) ? node->left : node->right;
+        }
+        return nullptr;
+    }
+
+    Memory::Memory(const std::vector<uint>& sizes) : mode(FIXED), totalSize(0), freeMemory(0) {
+        for (uint i = 0; i < sizes.size(); i++) {
+            partitions.push_back(Partition{.partitionNum = i + 1, .size = sizes[i], .code = -1, .start = totalSize, .used = 0});
+            freePartitions.insert({sizes[i], -(int) i});
+            totalSize += sizes[i];
+        }
+        freeMemory = totalSize;
+    }
+
+    Memory::Memory(MemoryMode mode, uint totalSize) : mode(mode), totalSize(totalSize), freeMemory(totalSize) {
+        if (mode == BUDDY) {
+            //Cut the address space into the largest aligned power of two blocks that fit
+            buddyBlocks.resize(32);
+            uint start = 0;
+            for (int order = 31; order >= 0; order--) {
+                if ((totalSize - start) >= (1u << order)) {
+                    buddyBlocks[order].insert(start);
+                    start += (1u << order);
+                }
+            }
+        } else if (totalSize > 0) {
+            holes.insert(0, totalSize);
+        }
+    }
+
+    Partition* Memory::allocate(uint size, int pid) {
+        uint needed = size;
+        if (mode == FIXED) {
+            //The best fit is the smallest free partition that is at least as big as the process
+            auto best = freePartitions.lower_bound({size, INT_MIN});
+            if (best == freePartitions.end()) {
+                return nullptr;
+            }
+            Partition* partition = &partitions[-best->second];
+            freePartitions.erase(best);
+            partition->code = pid;
+            partition->used = size;
+            freeMemory -= partition->size;
+            usedMemory += size;
+            return partition;
+        }
+        size = max(size, 1u);
+        uint start = 0;
+        uint blockSize = size;
+        if (mode == BUDDY) {
+            uint order = 0;
+            while ((1u << order) < size && order < 31) {
+                order++;
+            }
+            //Take the lowest block of the smallest order that is big enough, then split it down
+            uint k = order;
+            while (k < buddyBlocks.size() && buddyBlocks[k].empty()) {
+                k++;
+            }
+            if (k == buddyBlocks.size() || (1u << order) < size) {
+                return nullptr;
+            }
+            start = *buddyBlocks[k].begin();
+            buddyBlocks[k].erase(buddyBlocks[k].begin());
+            while (k > order) {
+                k--;
+                buddyBlocks[k].insert(start + (1u << k));
+            }
+            blockSize = 1u << order;
+        } else {
+            FreeList::Node* hole = nullptr;
+            if (mode == FIRST_FIT) {
+                hole = holes.firstFit(size, 0);
+            } else if (mode == NEXT_FIT) {
+                hole = holes.firstFit(size, nextFitStart);
+                if (hole == nullptr) {
+                    hole = holes.firstFit(size, 0);
+                }
+            } else {
+                hole = holes.bestFit(size);
+            }
+            if (hole == nullptr) {
+                return nullptr;
+            }
+            start = hole->start;
+            uint holeSize = hole->size;
+            holes.erase(start);
+            if (holeSize > size) {
+                holes.insert(start + size, holeSize - size);
+            }
+            nextFitStart = start + size;
+        }
+        freeMemory -= blockSize;
+        usedMemory += needed;
+        //Dynamic blocks are identified by their start address rather than a number
+        Partition& partition = blocks[start];
+        partition = Partition{.partitionNum = 0, .size = blockSize, .code = pid, .start = start, .used = needed};
+        return &partition;
+    }
+
+    void Memory::release(Partition* partition) {
+        if (mode == FIXED) {
+            partition->code = -1;
+            freePartitions.insert({partition->size, -(int) (partition->partitionNum - 1)});
+            freeMemory += partition->size;
+            usedMemory -= partition->used;
+            partition->used = 0;
+            return;
+        }
+        uint start = partition->start;
+        uint size = partition->size;
+        usedMemory -= partition->used;
+        blocks.erase(start);
+        freeMemory += size;
+        if (mode == BUDDY) {
+            //Keep merging with the buddy while it is free
+            uint order = 0;
+            while ((1u << order) < size) {
+                order++;
+            }
+            while (order + 1 < buddyBlocks.size()) {
+                uint buddy = start ^ (1u << order);
+                if (buddyBlocks[order].erase(buddy) == 0) {
+                    break;
+                }
+                start = min(start, buddy);
+                order++;
+            }
+            buddyBlocks[order].insert(start);
+            return;
+        }
+        //Coalesce with the holes on either side
+        uint end = start + size;
+        FreeList::Node* previous = holes.before(start);
+        if (previous != nullptr && previous->start + previous->size == start) {
+            start = previous->start;
+            size += previous->size;
+            holes.erase(start);
+        }
+        FreeList::Node* following = holes.at(end);
+        if (following != nullptr) {
+            size += following->size;
+            holes.erase(end);
+        }
+        holes.insert(start, size);
+    }
+
+    uint Memory::largestFree() const {
+        switch (mode) {
+            case FIXED:
+                return freePartitions.empty() ? 0 : freePartitions.rbegin()->first;
+            case BUDDY:
+                for (int order = buddyBlocks.size() - 1; order >= 0; order--) {
+                    if (!buddyBlocks[order].empty()) {
+                        return 1u << order;
+                    }
+                }
+                return 0;
+            default:
+                return holes.largest();
+        }
+    }
+
+    bool Memory::fits(uint size) const {
+        if (mode == FIXED) {
+            return !freePartitions.empty() && size <= freePartitions.rbegin()->first;
+        }
+        //allocate gives empty processes a unit of memory, and every buddy block is a power of two at least that big
+        return max(size, 1u) <= largestFree();
+    }
+}
+
 namespace Parsing
 {
 
-    deque<MemoryStructures::PcbEntry*> loadPCBTable(string fileName)
+    vector<MemoryStructures::PcbEntry> loadPCBTable(string fileName)
+    {
+        vector<MemoryStructures::PcbEntry> pcbTable;
+        int fd = open(fileName.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) < 0) {
+            cerr << "Unable to open input file " << fileName << '\n';
+            exit(1);
+        }
+        size_t length = info.st_size;
+        if (length == 0) {
+            close(fd);
+            return pcbTable;
+        }
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            cerr << "Unable to map input file " << fileName << '\n';
+            exit(1);
+        }
+        madvise(mapped, length, MADV_SEQUENTIAL);
+        const char* begin = (const char*) mapped;
+        if (length >= sizeof(WorkloadHeader) && memcmp(begin, WORKLOAD_MAGIC, sizeof(WORKLOAD_MAGIC)) == 0) {
+            pcbTable = readBinaryWorkload(begin, begin + length, fileName);
+        } else {
+            pcbTable = parseTextWorkload(begin, begin + length, fileName);
+        }
+        munmap(mapped, length);
+        return pcbTable;
+    }
+
+    /**
+     * This function reads the six comma separated numbers of a single process. Exits the program if they are not there.
+     * @param cursor - the start of the process
+     * @param end - the end of the text
+     * @param process - where the numbers go
+     * @param line - the line the process is on, for error messages
+     * @param fileName - the name of the file, for error messages
+     * @return where the process ends, which is the end of its line
+    */
+    static const char* parseTextProcess(const char* cursor, const char* end, MemoryStructures::PcbEntry& process, int line, const string& fileName)
+    {
+        uint fields[6];
+        for (int i = 0; i < 6; i++) {
+            while (cursor < end && (*cursor == ',' || *cursor == ' ' || *cursor == '\t')) {
+                cursor++;
+            }
+            auto [next, error] = from_chars(cursor, end, fields[i]);
+            if (error != errc()) {
+                cerr << "Invalid process on line " << line << " of " << fileName << '\n';
+                exit(1);
+            }
+            cursor = next;
+        }
+        while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')) {
+            cursor++;
+        }
+        if (cursor < end && *cursor != '\n') {
+            cerr << "Too many values on line " << line << " of " << fileName << '\n';
+            exit(1);
+        }
+        process.pid = fields[0];
+        process.memorySize = fields[1];
+        process.arrivalTime = fields[2];
+        process.totalCPUTime = fields[3];
+        process.ioFrequency = fields[4];
+        process.ioDuration = fields[5];
+        return cursor;
+    }
+
+    vector<MemoryStructures::PcbEntry> parseTextWorkload(const char* begin, const char* end, string fileName)
+    {
+        vector<MemoryStructures::PcbEntry> pcbTable;
+        const char* cursor = begin;
+        //Every process is on its own line, so this is enough room for all of them in one allocation
+        pcbTable.reserve(count(cursor, end, '\n') + 1);
+        int line = 1;
+        while (true) {
+            //Skip to the start of the next process, ignoring blank lines
+            while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r' || *cursor == '\n')) {
+                line += (*cursor == '\n');
+                cursor++;
+            }
+            if (cursor == end) {
+                break;
+            }
+            cursor = parseTextProcess(cursor, end, pcbTable.emplace_back(), line, fileName);
+        }
+        return pcbTable;
+    }
+
+    WorkloadStream::WorkloadStream(string fileName) : fileName(fileName)
+    {
+        if (fileName == "-") {
+            input = &cin;
+            this->fileName = "the standard input";
+        } else {
+            file.open(fileName, ios::binary);
+            if (file.fail()) {
+                cerr << "Unable to open input file " << fileName << '\n';
+                exit(1);
+            }
+            input = &file;
+        }
+        //Text never starts with the magic, so the first character is enough to tell the formats apart
+        if (input->peek() == WORKLOAD_MAGIC[0]) {
+            WorkloadHeader header;
+            input->read((char*) &header, sizeof(header));
+            if (input->fail() || memcmp(header.magic, WORKLOAD_MAGIC, sizeof(WORKLOAD_MAGIC)) != 0) {
+                cerr << "Invalid workload header in " << this->fileName << '\n';
+                exit(1);
+            }
+            if (header.version != WORKLOAD_VERSION || header.recordSize != sizeof(WorkloadRecord)) {
+                cerr << "Unsupported workload version " << header.version << " in " << this->fileName << '\n';
+                exit(1);
+            }
+            binary = true;
+        }
+    }
+
+    bool WorkloadStream::next(MemoryStructures::PcbEntry& process)
+    {
+        if (binary) {
+            WorkloadRecord record;
+            input->read((char*) &record, sizeof(record));
+            if (input->gcount() == 0) {
+                return false;
+            }
+            if (input->gcount() != sizeof(record)) {
+                cerr << "Workload " << fileName << " is truncated" << '\n';
+                exit(1);
+            }
+            process.pid = record.pid;
+            process.memorySize = record.memorySize;
+            process.arrivalTime = record.arrivalTime;
+            process.totalCPUTime = record.totalCPUTime;
+            process.ioFrequency = record.ioFrequency;
+            process.ioDuration = record.ioDuration;
+        } else {
+            //Skip blank lines, a process is only parsed once its whole line is in
+            string text;
+            do {
+                if (!getline(*input, text)) {
+                    return false;
+                }
+                line++;
+            } while (all_of(text.begin(), text.end(), [](char c) { return isspace((unsigned char) c); }));
+            parseTextProcess(text.data(), text.data() + text.size(), process, line, fileName);
+        }
+        //Processes are admitted as soon as they are read, so one arriving earlier than the last would be missed
+        if (process.arrivalTime < lastArrival) {
+            cerr << "Process " << process.pid << " in " << fileName << " arrives before the one ahead of it, a streamed workload must be in arrival order" << '\n';
+            exit(1);
+        }
+        lastArrival = process.arrivalTime;
+        return true;
+    }
+
+    vector<MemoryStructures::PcbEntry> readBinaryWorkload(const char* begin, const char* end, string fileName)
+    {
+        WorkloadHeader header;
+        memcpy(&header, begin, sizeof(header));
+        if (header.version != WORKLOAD_VERSION || header.recordSize != sizeof(WorkloadRecord)) {
+            cerr << "Unsupported workload version " << header.version << " in " << fileName << '\n';
+            exit(1);
+        }
+        if ((size_t) (end - begin - sizeof(header)) / sizeof(WorkloadRecord) < header.recordCount) {
+            cerr << "Workload " << fileName << " is truncated" << '\n';
+            exit(1);
+        }
+        const WorkloadRecord* records = (const WorkloadRecord*) (begin + sizeof(header));
+        vector<MemoryStructures::PcbEntry> pcbTable(header.recordCount);
+        for (size_t i = 0; i < header.recordCount; i++) {
+            pcbTable[i].pid = records[i].pid;
+            pcbTable[i].memorySize = records[i].memorySize;
+            pcbTable[i].arrivalTime = records[i].arrivalTime;
+            pcbTable[i].totalCPUTime = records[i].totalCPUTime;
+            pcbTable[i].ioFrequency = records[i].ioFrequency;
+            pcbTable[i].ioDuration = records[i].ioDuration;
+        }
+        return pcbTable;
+    }
+
+    void writeBinaryWorkload(const vector<MemoryStructures::PcbEntry>& pcbTable, string fileName)
+    {
+        ofstream output(fileName, ios::binary);
+        if (output.fail()) {
+            cout << "Unable to open workload output file." << endl;
+            exit(1);
+        }
+        WorkloadHeader header = {};
+        memcpy(header.magic, WORKLOAD_MAGIC, sizeof(WORKLOAD_MAGIC));
+        header.version = WORKLOAD_VERSION;
+        header.recordSize = sizeof(WorkloadRecord);
+        header.recordCount = pcbTable.size();
+        header.minArrival = pcbTable.empty() ? 0 : UINT32_MAX;
+        for (const MemoryStructures::PcbEntry& p : pcbTable) {
+            header.minArrival = min(header.minArrival, (uint32_t) p.arrivalTime);
+            header.maxArrival = max(header.maxArrival, (uint32_t) p.arrivalTime);
+        }
+        output.write((const char*) &header, sizeof(header));
+        vector<WorkloadRecord> records;
+        records.reserve(pcbTable.size());
+        for (const MemoryStructures::PcbEntry& p : pcbTable) {
+            records.push_back(WorkloadRecord{p.pid, p.memorySize, p.arrivalTime, p.totalCPUTime, p.ioFrequency, p.ioDuration});
+        }
+        output.write((const char*) records.data(), records.size() * sizeof(WorkloadRecord));
+        if (output.fail()) {
+            cout << "Unable to write workload output file." << endl;
+            exit(1);
+        }
+    }
+
+    void writeTextWorkload(const vector<MemoryStructures::PcbEntry>& pcbTable, string fileName)
+    {
+        ofstream output(fileName);
+        if (output.fail()) {
+            cout << "Unable to open workload output file." << endl;
+            exit(1);
+        }
+        for (const MemoryStructures::PcbEntry& p : pcbTable) {
+            output << p.pid << ", " << p.memorySize << ", " << p.arrivalTime << ", " << p.totalCPUTime << ", " << p.ioFrequency << ", " << p.ioDuration << '\n';
+        }
+    }
+
+    void convertWorkload(string inputFile, string outputFile)
+    {
+        //Look at the header to decide which way to convert
+        char magic[sizeof(WORKLOAD_MAGIC)] = {};
+        ifstream input(inputFile, ios::binary);
+        input.read(magic, sizeof(magic));
+        input.close();
+        vector<MemoryStructures::PcbEntry> pcbTable = loadPCBTable(inputFile);
+        if (memcmp(magic, WORKLOAD_MAGIC, sizeof(WORKLOAD_MAGIC)) == 0) {
+            writeTextWorkload(pcbTable, outputFile);
+        } else {
+            writeBinaryWorkload(pcbTable, outputFile);
+        }
+        cout << "Converted " << pcbTable.size() << " processes to " << outputFile << endl;
+    }
+
+    SnapshotWriter::SnapshotWriter(string fileName) : file(fileName, ios::binary), fileName(fileName)
     {
-        deque<MemoryStructures::PcbEntry*> pcbTable;
-        ifstream input;
-        try {
-            input.open(fileName);
-        } catch (const exception &e) {
-            cerr << e.what() << '\n';
+        if (file.fail()) {
+            cout << "Unable to open snapshot file " << fileName << endl;
             exit(1);
         }
-        while(!input.eof()) 
-        {
-            // Create a new PcbEntry
-            MemoryStructures::PcbEntry* newProcess = new MemoryStructures::PcbEntry();
-            string text;
-            getline(input, text);
-            for (int i = 0, len = text.size(); i < len; i++)
-            {
-                if (text[i] == ',')
-                {
-                    text.erase(i--, 1);
-                    len = text.size();
-                }
-            }
+        file.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        put(SNAPSHOT_VERSION);
+    }
+
+    void SnapshotWriter::putString(const string& text)
+    {
+        put<uint64_t>(text.size());
+        file.write(text.data(), text.size());
+    }
+
+    void SnapshotWriter::close()
+    {
+        file.close();
+        if (file.fail()) {
+            cout << "Unable to write snapshot file " << fileName << endl;
+            exit(1);
+        }
+    }
+
+    SnapshotReader::SnapshotReader(string fileName) : file(fileName, ios::binary), fileName(fileName)
+    {
+        if (file.fail()) {
+            cout << "Unable to open snapshot file " << fileName << endl;
+            exit(1);
+        }
+        char magic[sizeof(SNAPSHOT_MAGIC)];
+        file.read(magic, sizeof(magic));
+        if (file.fail() || memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0) {
+            cout << fileName << " is not a snapshot." << endl;
+            exit(1);
+        }
+        if (get<uint32_t>() != SNAPSHOT_VERSION) {
+            cout << fileName << " was written by a different version of the simulator." << endl;
+            exit(1);
+        }
+    }
+
+    void SnapshotReader::check()
+    {
+        if (file.fail()) {
+            cout << "Snapshot file " << fileName << " is truncated." << endl;
+            exit(1);
+        }
+    }
+
+    string SnapshotReader::getString()
+    {
+        string text(get<uint64_t>(), '\0');
+        file.read(text.data(), text.size());
+        check();
+        return text;
+    }
+
+    void writeSnapshotOptions(SnapshotWriter& snapshot, const Options& options)
+    {
+        snapshot.putString(options.inputFile);
+        snapshot.putString(options.strategy);
+        snapshot.putString(options.outputDir);
+        snapshot.put(options.eventDriven);
+        snapshot.put(options.asyncTrace);
+        snapshot.put(options.traceFiles);
+        snapshot.put(options.metricsJson);
+        snapshot.put(options.metricsCsv);
+        snapshot.put(options.cpus);
+        snapshot.put(options.quantum);
+        snapshot.putVector(options.partitionSizes);
+        snapshot.put(options.memoryMode);
+        snapshot.put(options.memorySize);
+        snapshot.put(options.gantt);
+        snapshot.putString(options.ganttChart);
+        snapshot.put(options.index);
+    }
+
+    Options readSnapshotOptions(SnapshotReader& snapshot)
+    {
+        Options options;
+        options.inputFile = snapshot.getString();
+        options.strategy = snapshot.getString();
+        options.outputDir = snapshot.getString();
+        options.eventDriven = snapshot.get<bool>();
+        options.asyncTrace = snapshot.get<bool>();
+        options.traceFiles = snapshot.get<bool>();
+        options.metricsJson = snapshot.get<bool>();
+        options.metricsCsv = snapshot.get<bool>();
+        options.cpus = snapshot.get<uint>();
+        options.quantum = snapshot.get<uint>();
+        options.partitionSizes = snapshot.getVector<uint>();
+        options.memoryMode = snapshot.get<MemoryStructures::MemoryMode>();
+        options.memorySize = snapshot.get<uint>();
+        options.gantt = snapshot.get<bool>();
+        options.ganttChart = snapshot.getString();
+        options.index = snapshot.get<bool>();
+        return options;
+    }
+
+    deque<string> grabStudentNumbers(string fileName)
+    {
+        deque<string> ids;
+        stringstream ss(fileName.substr(0, fileName.find_first_of('.')));
+        string s;
+        while (getline(ss, s, '_'))
+        { // while for any args
+            bool isStudentId = true;
+            // Check if the argument is a string or an integer
+            for (size_t i = 0; i < s.size(); i++)
+            {
+                if (!isdigit(s[i]))
+                {
+                    isStudentId = false;
+                    break;
+                }
+            }
+            if (isStudentId) {
+                ids.push_back(s);
+            }
+        }
+        return ids;
+    }
+
+    string getOutputFilename(string prefix, string fileName, string extension) {
+        deque<string> studentNums = grabStudentNumbers(fileName);
+        string outputName = prefix;
+        for (string s : studentNums) {
+            outputName += ("_" + s);
+        }
+        outputName += extension;
+        return outputName;
+    }
+
+    Options parseArguments(int argc, char *argv[]) {
+        // Check to make sure there are arguments
+        if (argc < ARGUMENT_NUM)
+        {
+            cout << "There must be " << ARGUMENT_NUM << " argument." << endl;
+            exit(1);
+        }
+        Options options;
+        if (string(argv[1]) == "--convert") {
+            if (argc != 4) {
+                cout << "Usage: --convert <input file> <output file>" << endl;
+                exit(1);
+            }
+            options.convert = true;
+            options.inputFile = argv[2];
+            options.outputFile = argv[3];
+            return options;
+        }
+        if (string(argv[1]) == "--render-gantt") {
+            if (argc != 4) {
+                cout << "Usage: --render-gantt <intervals file> <chart file>" << endl;
+                exit(1);
+            }
+            options.renderGantt = true;
+            options.inputFile = argv[2];
+            options.outputFile = argv[3];
+            return options;
+        }
+        if (string(argv[1]) == "--build-index") {
+            if (argc != 3) {
+                cout << "Usage: --build-index <execution table>" << endl;
+                exit(1);
+            }
+            options.buildIndex = true;
+            options.inputFile = argv[2];
+            return options;
+        }
+        if (string(argv[1]) == "--query") {
+            if (argc != 4) {
+                cout << "Usage: --query <execution table> --at=<time> | --range=<start>,<end> | --pid=<pid>" << endl;
+                exit(1);
+            }
+            options.inputFile = argv[2];
+            options.query = argv[3];
+            return options;
+        }
+        if (string(argv[1]) == "--batch") {
+            options.batch = true;
+            options.inputFile = argv[2];
+            options.strategies = {"FCFS", "EP", "RR"};
+        } else if (string(argv[1]) == "--sweep") {
+            options.sweep = true;
+            options.inputFile = argv[2];
+            options.strategies = {"RR"};
+            options.outputDir = "sweep_output";
+        } else if (string(argv[1]) == "--restore") {
+            //Start from the options the snapshot was taken with, the flags can then change some of them
+            SnapshotReader snapshot(argv[2]);
+            options = readSnapshotOptions(snapshot);
+            options.restore = true;
+            options.snapshotFile = argv[2];
+        } else {
+            options.inputFile = argv[1];
+            options.strategy = argv[2];
+            //- is the standard input, which can only be read as it comes
+            options.stream = options.inputFile == "-";
+        }
+        if (!options.restore) {
+            options.partitionSizes.assign(MemoryStructures::PARTITION_SIZES, MemoryStructures::PARTITION_SIZES + MemoryStructures::PARTITION_NUM);
+        }
+        Options original = options;
+        for (int i = ARGUMENT_NUM; i < argc; i++) {
+            string arg = argv[i];
+            if (arg == "--engine=event") {
+                options.eventDriven = true;
+            } else if (arg == "--engine=tick") {
+                options.eventDriven = false;
+            } else if (arg == "--trace=async") {
+                options.asyncTrace = true;
+            } else if (arg == "--trace=sync") {
+                options.asyncTrace = false;
+            } else if (arg == "--trace=none") {
+                options.traceFiles = false;
+            } else if (arg.rfind("--metrics=", 0) == 0) {
+                stringstream formats(arg.substr(arg.find('=') + 1));
+                options.metricsJson = false;
+                options.metricsCsv = false;
+                for (string format; getline(formats, format, ',');) {
+                    if (format == "json") {
+                        options.metricsJson = true;
+                    } else if (format == "csv") {
+                        options.metricsCsv = true;
+                    } else {
+                        cout << "Unknown metrics format: " << format << endl;
+                        exit(1);
+                    }
+                }
+                if (!options.metricsJson && !options.metricsCsv) {
+                    cout << "Invalid value for --metrics: no formats were given." << endl;
+                    exit(1);
+                }
+            } else if (arg.rfind("--partitions=", 0) == 0) {
+                options.partitionSizes = parsePartitionSizes(arg.substr(arg.find('=') + 1));
+            } else if (arg.rfind("--partition-file=", 0) == 0) {
+                options.partitionSizes = loadPartitionSizes(arg.substr(arg.find('=') + 1));
+            } else if (arg.rfind("--memory=", 0) == 0) {
+                options.memoryMode = parseMemoryMode(arg.substr(arg.find('=') + 1));
+            } else if (arg.rfind("--memory-size=", 0) == 0) {
+                options.memorySize = parsePositive("--memory-size", arg.substr(arg.find('=') + 1));
+            } else if (arg.rfind("--strategies=", 0) == 0) {
+                string list = arg.substr(arg.find('=') + 1);
+                replace(list.begin(), list.end(), ',', ' ');
+                stringstream ss(list);
+                options.strategies.clear();
+                for (string strategy; ss >> strategy;) {
+                    options.strategies.push_back(parseStrategy(strategy));
+                }
+                if (options.strategies.empty()) {
+                    cout << "Invalid value for --strategies: no strategies were given." << endl;
+                    exit(1);
+                }
+            } else if (arg.rfind("--cpus=", 0) == 0) {
+                options.cpus = parsePositive("--cpus", arg.substr(arg.find('=') + 1));
+            } else if (arg.rfind("--strategy=", 0) == 0) {
+                options.strategy = parseStrategy(arg.substr(arg.find('=') + 1));
+            } else if (arg.rfind("--checkpoint-at=", 0) == 0) {
+                stringstream times(arg.substr(arg.find('=') + 1));
+                options.checkpoints.clear();
+                for (string time; getline(times, time, ',');) {
+                    options.checkpoints.push_back(parseNonNegative("--checkpoint-at", time));
+                }
+                if (options.checkpoints.empty()) {
+                    cout << "Invalid value for --checkpoint-at: no times were given." << endl;
+                    exit(1);
+                }
+                sort(options.checkpoints.begin(), options.checkpoints.end());
+            } else if (arg.rfind("--quantum=", 0) == 0) {
+                options.quantum = parsePositive("--quantum", arg.substr(arg.find('=') + 1));
+            } else if (arg.rfind("--quanta=", 0) == 0) {
+                stringstream quanta(arg.substr(arg.find('=') + 1));
+                options.quanta.clear();
+                for (string quantum; getline(quanta, quantum, ',');) {
+                    options.quanta.push_back(parsePositive("--quanta", quantum));
+                }
+                if (options.quanta.empty()) {
+                    cout << "Invalid value for --quanta: no quanta were given." << endl;
+                    exit(1);
+                }
+            } else if (arg.rfind("--layouts=", 0) == 0) {
+                options.layouts = parseLayouts(arg.substr(arg.find('=') + 1));
+            } else if (arg.rfind("--jobs=", 0) == 0) {
+                options.jobs = parsePositive("--jobs", arg.substr(arg.find('=') + 1));
+            } else if (arg.rfind("--output-dir=", 0) == 0) {
+                options.outputDir = arg.substr(arg.find('=') + 1);
+            } else if (arg == "--stream") {
+                options.stream = true;
+            } else if (arg == "--gantt" || arg == "--gantt=csv") {
+                options.gantt = true;
+                options.ganttChart = "";
+            } else if (arg == "--gantt=svg" || arg == "--gantt=html") {
+                options.gantt = true;
+                options.ganttChart = arg.substr(arg.find('=') + 1);
+            } else if (arg == "--gantt=none") {
+                options.gantt = false;
+                options.ganttChart = "";
+            } else if (arg == "--index") {
+                options.index = true;
+            } else {
+                cout << "Unknown option: " << arg << endl;
+                exit(1);
+            }
+        }
+        //The layout of memory and the CPUs are part of the snapshot
+        if (options.restore && (options.cpus != original.cpus || options.memoryMode != original.memoryMode
+                || options.memorySize != original.memorySize || options.partitionSizes != original.partitionSizes)) {
+            cout << "The memory and CPUs cannot be changed when restoring a snapshot." << endl;
+            exit(1);
+        }
+        //A stream cannot be read twice, and what has been read of it is not kept
+        if (options.stream && (options.batch || options.sweep || options.restore)) {
+            cout << "Only a single simulation can stream its input." << endl;
+            exit(1);
+        }
+        if (options.stream && !options.checkpoints.empty()) {
+            cout << "A streamed simulation cannot be checkpointed." << endl;
+            exit(1);
+        }
+        if (options.index && !options.traceFiles) {
+            cout << "Only the execution table can be indexed, so it cannot be left out." << endl;
+            exit(1);
+        }
+        return options;
+    }
+
+    vector<vector<uint>> parseLayouts(string text) {
+        vector<vector<uint>> layouts;
+        stringstream ss(text);
+        for (string layout; getline(ss, layout, '/');) {
+            layouts.push_back(parsePartitionSizes(layout));
+        }
+        return layouts;
+    }
+
+    vector<uint> parsePartitionSizes(string text) {
+        vector<uint> sizes;
+        replace(text.begin(), text.end(), ',', ' ');
+        stringstream ss(text);
+        string s;
+        while (ss >> s) {
+            try {
+                int size = stoi(s);
+                if (size <= 0) {
+                    throw invalid_argument("partition sizes must be positive");
+                }
+                sizes.push_back(size);
+            } catch (const exception &e) {
+                cout << "Invalid partition size " << s << ": " << e.what() << endl;
+                exit(1);
+            }
+        }
+        if (sizes.empty()) {
+            cout << "There must be at least one partition." << endl;
+            exit(1);
+        }
+        return sizes;
+    }
+
+    uint parsePositive(string flag, string text) {
+        uint value = 0;
+        auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+        if (error != errc() || end != text.data() + text.size() || value == 0) {
+            cout << "Invalid value for " << flag << ": " << text << " is not a single positive number." << endl;
+            exit(1);
+        }
+        return value;
+    }
+
+    int parseNonNegative(string flag, string text) {
+        int value = 0;
+        auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+        if (error != errc() || end != text.data() + text.size() || value < 0) {
+            cout << "Invalid value for " << flag << ": " << text << " is not a single number that is 0 or more." << endl;
+            exit(1);
+        }
+        return value;
+    }
+
+    vector<uint> loadPartitionSizes(string fileName) {
+        ifstream input(fileName);
+        if (input.fail()) {
+            cout << "Unable to open partition file " << fileName << endl;
+            exit(1);
+        }
+        stringstream contents;
+        contents << input.rdbuf();
+        return parsePartitionSizes(contents.str());
+    }
+
+    MemoryStructures::MemoryMode parseMemoryMode(string name) {
+        if (name == "fixed") {
+            return MemoryStructures::FIXED;
+        } else if (name == "first-fit") {
+            return MemoryStructures::FIRST_FIT;
+        } else if (name == "next-fit") {
+            return MemoryStructures::NEXT_FIT;
+        } else if (name == "best-fit") {
+            return MemoryStructures::BEST_FIT;
+        } else if (name == "buddy") {
+            return MemoryStructures::BUDDY;
+        }
+        cout << "Unknown memory mode: " << name << endl;
+        exit(1);
+    }
+
+    string parseStrategy(string name) {
+        if (name == "FCFS" || name == "EP" || name == "RR" || name == "SJF" || name == "SRTF" || name == "MLFQ" || name == "CFS") {
+            return name;
+        }
+        cout << "Unknown strategy: " << name << endl;
+        exit(1);
+    }
+}
+
+namespace Output
+{
+    bool BufferedFile::open(string fileName, bool append)
+    {
+        file.open(fileName, append ? ios::app : ios::trunc);
+        buffer.reserve(BUFFER_SIZE);
+        written = append ? filesystem::file_size(fileName) : 0;
+        return !file.fail();
+    }
+
+    void BufferedFile::append(const char* text, size_t length)
+    {
+        if (buffer.size() + length > BUFFER_SIZE) {
+            flush();
+        }
+        buffer.append(text, length);
+    }
+
+    void BufferedFile::appendRight(const char* text, size_t length, size_t width)
+    {
+        if (length < width) {
+            buffer.append(width - length, ' ');
+        }
+        append(text, length);
+    }
+
+    void BufferedFile::appendRight(long value, size_t width)
+    {
+        char digits[24];
+        auto [end, error] = to_chars(digits, digits + sizeof(digits), value);
+        appendRight(digits, end - digits, width);
+    }
+
+    void BufferedFile::flush()
+    {
+        file.write(buffer.data(), buffer.size());
+        written += buffer.size();
+        buffer.clear();
+    }
+
+    void BufferedFile::close()
+    {
+        flush();
+        file.close();
+    }
+
+    bool RecordRing::push(const TraceRecord& record)
+    {
+        size_t position = tail.load(memory_order_relaxed);
+        if (position - head.load(memory_order_acquire) == slots.size()) {
+            return false; //full
+        }
+        slots[position % slots.size()] = record;
+        tail.store(position + 1, memory_order_release);
+        return true;
+    }
+
+    bool RecordRing::pop(TraceRecord& record)
+    {
+        size_t position = head.load(memory_order_relaxed);
+        if (position == tail.load(memory_order_acquire)) {
+            return false; //empty
+        }
+        record = slots[position % slots.size()];
+        head.store(position + 1, memory_order_release);
+        return true;
+    }
+
+    size_t TextRing::push(const char* text, size_t length)
+    {
+        size_t position = tail.load(memory_order_relaxed);
+        length = min(length, bytes.size() - (position - head.load(memory_order_acquire)));
+        //The text may wrap around the end of the ring
+        size_t start = position % bytes.size();
+        size_t first = min(length, bytes.size() - start);
+        memcpy(bytes.data() + start, text, first);
+        memcpy(bytes.data(), text + first, length - first);
+        tail.store(position + length, memory_order_release);
+        return length;
+    }
+
+    size_t TextRing::pop(string& text, size_t length)
+    {
+        size_t position = head.load(memory_order_relaxed);
+        length = min(length, tail.load(memory_order_acquire) - position);
+        size_t start = position % bytes.size();
+        size_t first = min(length, bytes.size() - start);
+        text.append(bytes.data() + start, first);
+        text.append(bytes.data(), length - first);
+        head.store(position + length, memory_order_release);
+        return length;
+    }
+
+    void TraceWriter::open(string executionFileName, string memoryStatusFileName, bool background)
+    {
+        if (!memoryStatus.open(memoryStatusFileName))
+        {
+            cout << "Unable to open memory status output file." << std::endl;
+            exit(1);
+        }
+        if (!execution.open(executionFileName))
+        {
+            cout << "Unable to open execution output file." << std::endl;
+            exit(1);
+        }
+        opened = true;
+        this->executionFileName = executionFileName;
+        this->memoryStatusFileName = memoryStatusFileName;
+        async = background;
+        if (async) {
+            worker = thread(&TraceWriter::drain, this);
+        }
+    }
+
+    //Makes a file hold the first part of another one, or cuts it down if it is the same file
+    static void keepPrefix(string fileName, string sourceName, uint64_t size)
+    {
+        error_code error;
+        if (filesystem::exists(fileName) && filesystem::equivalent(fileName, sourceName, error)) {
+            if (filesystem::file_size(fileName) < size) {
+                cout << "Output file " << fileName << " is shorter than it was when the snapshot was taken." << endl;
+                exit(1);
+            }
+            filesystem::resize_file(fileName, size);
+            return;
+        }
+        ifstream source(sourceName, ios::binary);
+        if (!source.is_open()) {
+            cout << "Unable to open output file " << sourceName << " of the snapshot." << endl;
+            exit(1);
+        }
+        ofstream target(fileName, ios::binary | ios::trunc);
+        if (!target.is_open()) {
+            cout << "Unable to open output file " << fileName << endl;
+            exit(1);
+        }
+        string prefix(size, '\0');
+        source.read(prefix.data(), size);
+        if (source.gcount() != (streamsize) size) {
+            cout << "Output file " << sourceName << " is shorter than it was when the snapshot was taken." << endl;
+            exit(1);
+        }
+        target.write(prefix.data(), size);
+        if (target.fail()) {
+            cout << "Unable to write output file " << fileName << endl;
+            exit(1);
+        }
+    }
+
+    void TraceWriter::resume(string executionFileName, string memoryStatusFileName, bool background, const TracePosition& from)
+    {
+        keepPrefix(memoryStatusFileName, from.memoryStatusFileName, from.memoryStatusSize);
+        keepPrefix(executionFileName, from.executionFileName, from.executionSize);
+        if (!memoryStatus.open(memoryStatusFileName, true))
+        {
+            cout << "Unable to open memory status output file." << std::endl;
+            exit(1);
+        }
+        if (!execution.open(executionFileName, true))
+        {
+            cout << "Unable to open execution output file." << std::endl;
+            exit(1);
+        }
+        opened = true;
+        this->executionFileName = executionFileName;
+        this->memoryStatusFileName = memoryStatusFileName;
+        async = background;
+        if (async) {
+            worker = thread(&TraceWriter::drain, this);
+        }
+    }
+
+    TracePosition TraceWriter::position()
+    {
+        TracePosition position;
+        if (!opened) {
+            return position;
+        }
+        //Stop the background writer once everything is formatted, then start it again
+        if (async) {
+            finished.store(true, memory_order_release);
+            wakeWorker();
+            worker.join();
+            finished.store(false, memory_order_relaxed);
+            worker = thread(&TraceWriter::drain, this);
+        }
+        execution.flush();
+        memoryStatus.flush();
+        //A restored simulation may run from another directory
+        position.executionFileName = filesystem::absolute(executionFileName).string();
+        position.memoryStatusFileName = filesystem::absolute(memoryStatusFileName).string();
+        position.executionSize = execution.size();
+        position.memoryStatusSize = memoryStatus.size();
+        return position;
+    }
+
+    void TraceWriter::submit(TraceRecord& record, string_view text)
+    {
+        if (!opened) {
+            return;
+        }
+        record.textLength = text.size();
+        if (!async) {
+            format(record, text);
+            return;
+        }
+        //The writer only falls this far behind on a burst of output, so wake it and wait for it to catch up
+        while (!ring.push(record)) {
+            wakeWorker();
+            this_thread::yield();
+        }
+        //The text follows its record, a long one in pieces as the writer makes room for it
+        while (!text.empty()) {
+            text.remove_prefix(textRing.push(text.data(), text.size()));
+            if (!text.empty()) {
+                wakeWorker();
+                this_thread::yield();
+            }
+        }
+        if (ring.size() >= TRACE_BATCH) {
+            wakeWorker();
+        }
+    }
+
+    void TraceWriter::wakeWorker()
+    {
+        //Pairs with the fence in drain, so either the writer sees the records or this sees it asleep
+        atomic_thread_fence(memory_order_seq_cst);
+        if (sleeping.load(memory_order_relaxed)) {
+            lock_guard<mutex> lock(wakeLock);
+            sleeping.store(false, memory_order_relaxed);
+            wake.notify_one();
+        }
+    }
+
+    void TraceWriter::drain()
+    {
+        TraceRecord record;
+        while (true) {
+            while (ring.pop(record)) {
+                //The text is pushed straight after its record, so it is at most a moment behind
+                text.clear();
+                while (text.size() < record.textLength) {
+                    if (textRing.pop(text, record.textLength - text.size()) == 0) {
+                        this_thread::yield();
+                    }
+                }
+                format(record, text);
+            }
+            //Everything pushed before finishing is visible once it is seen, so the ring is empty for good
+            if (finished.load(memory_order_acquire) && ring.size() == 0) {
+                return;
+            }
+            //Sleep until there is a batch to write, the simulator is waiting for room or it is finishing
+            unique_lock<mutex> lock(wakeLock);
+            sleeping.store(true, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+            if (ring.size() >= TRACE_BATCH || finished.load(memory_order_relaxed)) {
+                sleeping.store(false, memory_order_relaxed);
+                continue;
+            }
+            wake.wait(lock, [this] { return !sleeping.load(memory_order_relaxed); });
+        }
+    }
+
+    void TraceWriter::format(const TraceRecord& record, string_view text)
+    {
+        switch (record.kind) {
+            case EXECUTION_STEP:
+                //|Time of Transition |PID | Old State | New State |
+                execution.append("| ", 2);
+                execution.appendRight(record.time, 18);
+                execution.append(" | ", 3);
+                execution.appendRight(record.pid, 2);
+                execution.append(" | ", 3);
+                if (record.cpu >= 0) {
+                    execution.appendRight(record.cpu, 3);
+                    execution.append(" | ", 3);
+                }
+                execution.appendRight(MemoryStructures::stateName(record.from), 9);
+                execution.append(" | ", 3);
+                execution.appendRight(MemoryStructures::stateName(record.to), 9);
+                execution.append(" |\n", 3);
+                break;
+            case MEMORY_STATUS:
+                //| Time of Event | Memory Used | Partitions State | Total Free Memory | Usable Free Memory |
+                memoryStatus.append("| ", 2);
+                memoryStatus.appendRight(record.time, 13);
+                memoryStatus.append(" | ", 3);
+                memoryStatus.appendRight(record.memAllocated, 11);
+                memoryStatus.append(" | ", 3);
+                memoryStatus.appendRight(text, 16);
+                memoryStatus.append(" | ", 3);
+                memoryStatus.appendRight(record.totalFreeMemory, 17);
+                memoryStatus.append(" | ", 3);
+                memoryStatus.appendRight(record.usableFreeMemory, 18);
+                if (record.showFragmentation) {
+                    char percent[32];
+                    int length = snprintf(percent, sizeof(percent), "%.2f%%", record.fragmentation);
+                    memoryStatus.append(" | ", 3);
+                    memoryStatus.appendRight(percent, length, 22);
+                }
+                memoryStatus.append(" | \n", 4);
+                break;
+            case EXECUTION_TEXT:
+                execution.append(text);
+                execution.append("\n", 1);
+                break;
+            case MEMORY_TEXT:
+                memoryStatus.append(text);
+                memoryStatus.append("\n", 1);
+                break;
+        }
+    }
+
+    void TraceWriter::executionStep(int time, uint pid, MemoryStructures::ProcessState from, MemoryStructures::ProcessState to, int cpu)
+    {
+        TraceRecord record;
+        record.kind = EXECUTION_STEP;
+        record.time = time;
+        record.pid = pid;
+        record.from = from;
+        record.to = to;
+        record.cpu = cpu;
+        submit(record, {});
+    }
+
+    void TraceWriter::memoryStatusLine(int time, int memAllocated, string_view memoryState, int totalFreeMemory, int usableFreeMemory, bool showFragmentation, double fragmentation)
+    {
+        TraceRecord record;
+        record.kind = MEMORY_STATUS;
+        record.time = time;
+        record.memAllocated = memAllocated;
+        record.totalFreeMemory = totalFreeMemory;
+        record.usableFreeMemory = usableFreeMemory;
+        record.showFragmentation = showFragmentation;
+        record.fragmentation = fragmentation;
+        submit(record, memoryState);
+    }
+
+    void TraceWriter::executionText(string_view line)
+    {
+        TraceRecord record;
+        record.kind = EXECUTION_TEXT;
+        submit(record, line);
+    }
+
+    void TraceWriter::memoryText(string_view line)
+    {
+        TraceRecord record;
+        record.kind = MEMORY_TEXT;
+        submit(record, line);
+    }
+
+    void TraceWriter::close()
+    {
+        if (async) {
+            finished.store(true, memory_order_release);
+            wakeWorker();
+            worker.join();
+            async = false;
+        }
+        execution.close();
+        memoryStatus.close();
+    }
+
+    void GanttWriter::open(string fileName, bool multiCore)
+    {
+        if (!file.open(fileName)) {
+            cout << "Unable to open Gantt output file." << endl;
+            exit(1);
+        }
+        opened = true;
+        this->fileName = fileName;
+        this->multiCore = multiCore;
+        file.append(multiCore ? "pid,state,start,end,cpu\n" : "pid,state,start,end\n");
+    }
+
+    void GanttWriter::resume(string fileName, bool multiCore, string sourceName, uint64_t size)
+    {
+        keepPrefix(fileName, sourceName, size);
+        if (!file.open(fileName, true)) {
+            cout << "Unable to open Gantt output file." << endl;
+            exit(1);
+        }
+        opened = true;
+        this->fileName = fileName;
+        this->multiCore = multiCore;
+    }
+
+    uint64_t GanttWriter::position()
+    {
+        if (!opened) {
+            return 0;
+        }
+        file.flush();
+        return file.size();
+    }
+
+    void GanttWriter::interval(uint pid, MemoryStructures::ProcessState state, int start, int end, int cpu)
+    {
+        if (!opened || end <= start) {
+            return;
+        }
+        //A width of 0 writes the numbers without any padding
+        file.appendRight(pid, 0);
+        file.append((state == MemoryStructures::RUNNING) ? ",RUNNING," : ",WAITING,", 9);
+        file.appendRight(start, 0);
+        file.append(",", 1);
+        file.appendRight(end, 0);
+        if (multiCore) {
+            file.append(",", 1);
+            if (cpu >= 0) {
+                file.appendRight(cpu, 0);
+            }
+        }
+        file.append("\n", 1);
+    }
+
+    void GanttWriter::close()
+    {
+        if (opened) {
+            file.close();
+            opened = false;
+        }
+    }
+
+    //This structure is a single line of an intervals file
+    struct GanttInterval {
+        uint pid;
+        bool running; //RUNNING rather than WAITING
+        int start;
+        int end;
+        int cpu; //-1 if the line has none
+    };
+
+    //Reads a line of an intervals file, returning false for the header or anything else that is not an interval
+    static bool parseGanttInterval(const string& line, GanttInterval& interval)
+    {
+        const char* cursor = line.data();
+        const char* end = line.data() + line.size();
+        auto [afterPid, pidError] = from_chars(cursor, end, interval.pid);
+        if (pidError != errc() || afterPid == end || *afterPid != ',') {
+            return false;
+        }
+        cursor = afterPid + 1;
+        const char* comma = find(cursor, end, ',');
+        interval.running = string_view(cursor, comma - cursor) == "RUNNING";
+        if (!interval.running && string_view(cursor, comma - cursor) != "WAITING") {
+            return false;
+        }
+        cursor = comma + 1;
+        auto [afterStart, startError] = from_chars(cursor, end, interval.start);
+        if (startError != errc() || afterStart == end) {
+            return false;
+        }
+        auto [afterEnd, endError] = from_chars(afterStart + 1, end, interval.end);
+        if (endError != errc()) {
+            return false;
+        }
+        interval.cpu = -1;
+        if (afterEnd < end && *afterEnd == ',') {
+            from_chars(afterEnd + 1, end, interval.cpu);
+        }
+        return true;
+    }
+
+    //This is a box on the chart that has not been drawn yet, so the boxes after it can still be merged into it
+    struct GanttBox {
+        bool pending = false;
+        int start = 0;
+        int end = 0;
+        uint pid = 0;
+        bool mixed = false; //whether several processes were merged into it
+        long busy = 0; //the time the merged intervals cover, which shades a merged box
+    };
+
+    //Formats a position on a chart, to a hundredth of a pixel
+    static string formatPixels(double value)
+    {
+        char digits[32];
+        auto [end, error] = to_chars(digits, digits + sizeof(digits), value, chars_format::fixed, 2);
+        return string(digits, end);
+    }
+
+    //Picks a round step between the time labels so there are about ten of them
+    static int ganttTickStep(int endTime)
+    {
+        int step = 1;
+        while (step * 10 < endTime) {
+            if (step * 20 >= endTime) {
+                return step * 2;
+            } else if (step * 50 >= endTime) {
+                return step * 5;
+            }
+            step *= 10;
+        }
+        return step;
+    }
+
+    void renderGantt(string intervalFile, string chartFile)
+    {
+        //The first pass finds how long the chart is and how many CPUs it has
+        ifstream input(intervalFile);
+        if (input.fail()) {
+            cout << "Unable to open intervals file " << intervalFile << endl;
+            exit(1);
+        }
+        int endTime = 1;
+        int cpus = 1;
+        unsigned long count = 0;
+        GanttInterval interval;
+        for (string line; getline(input, line);) {
+            if (parseGanttInterval(line, interval)) {
+                endTime = max(endTime, interval.end);
+                cpus = max(cpus, interval.cpu + 1);
+                count++;
+            }
+        }
+
+        BufferedFile chart;
+        if (!chart.open(chartFile)) {
+            cout << "Unable to open chart file " << chartFile << endl;
+            exit(1);
+        }
+        bool html = filesystem::path(chartFile).extension() == ".html";
+        string title = "Gantt chart of " + filesystem::path(intervalFile).filename().string();
+        const int rows = cpus + 1; //the last row is the IO
+        const int width = GANTT_LABEL_WIDTH + GANTT_WIDTH + GANTT_MARGIN;
+        const int height = GANTT_MARGIN + rows * GANTT_ROW_HEIGHT + GANTT_AXIS_HEIGHT;
+        const double scale = (double) GANTT_WIDTH / endTime;
+        string text;
+        auto x = [&](int time) { return formatPixels(GANTT_LABEL_WIDTH + time * scale); };
+        auto y = [&](int row) { return to_string(GANTT_MARGIN + row * GANTT_ROW_HEIGHT); };
+        if (html) {
+            chart.append("<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<title>" + title + "</title>\n</head>\n<body>\n");
+            chart.append("<h1>" + title + "</h1>\n<p>" + to_string(count) + " intervals up to time " + to_string(endTime) + ". Hover over an interval to see it.</p>\n");
+        }
+        chart.append("<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" + to_string(width) + "\" height=\"" + to_string(height) + "\" font-family=\"sans-serif\" font-size=\"12\">\n");
+        if (!html) {
+            chart.append("<title>" + title + "</title>\n");
+        }
+        //Every row starts out gray, which is what is left showing where a CPU was idle
+        for (int row = 0; row < rows; row++) {
+            string name = (row == cpus) ? "IO" : "CPU " + to_string(row);
+            chart.append("<text x=\"4\" y=\"" + to_string(GANTT_MARGIN + row * GANTT_ROW_HEIGHT + GANTT_ROW_HEIGHT / 2 + 4) + "\">" + name + "</text>\n");
+            chart.append("<rect x=\"" + x(0) + "\" y=\"" + y(row) + "\" width=\"" + to_string(GANTT_WIDTH) + "\" height=\"" + to_string(GANTT_ROW_HEIGHT - 2) + "\" fill=\"#ddd\"/>\n");
+        }
+        //The time axis
+        const int axis = GANTT_MARGIN + rows * GANTT_ROW_HEIGHT;
+        int step = ganttTickStep(endTime);
+        for (int time = 0; time <= endTime; time += step) {
+            chart.append("<line x1=\"" + x(time) + "\" x2=\"" + x(time) + "\" y1=\"" + y(0) + "\" y2=\"" + to_string(axis + 4) + "\" stroke=\"#999\" stroke-width=\"0.5\"/>\n");
+            chart.append("<text x=\"" + x(time) + "\" y=\"" + to_string(axis + 18) + "\" text-anchor=\"middle\">" + to_string(time) + "</text>\n");
+        }
+
+        //The second pass draws the intervals. A box is held back until the next one in its row is too far away to
+        //merge with, so each row only ever has a single box waiting.
+        vector<GanttBox> boxes(rows);
+        auto draw = [&](int row, const GanttBox& box) {
+            double boxWidth = max((box.end - box.start) * scale, 0.5);
+            text = "<rect x=\"" + x(box.start) + "\" y=\"" + y(row) + "\" width=\"" + formatPixels(boxWidth) + "\" height=\"" + to_string(GANTT_ROW_HEIGHT - 2) + "\"";
+            if (box.mixed) {
+                double busy = min(1.0, (double) box.busy / max(box.end - box.start, 1));
+                text += " fill=\"#333\" fill-opacity=\"" + formatPixels(busy) + "\"><title>several processes " + to_string(box.start) + "-" + to_string(box.end) + "</title></rect>\n";
+            } else {
+                //Stepping the hue by close to the golden angle keeps consecutive pids apart
+                text += " fill=\"hsl(" + to_string(box.pid * 137 % 360) + ",65%,50%)\"" + ((row == cpus) ? " fill-opacity=\"0.4\"" : "");
+                text += "><title>pid " + to_string(box.pid) + " " + to_string(box.start) + "-" + to_string(box.end) + "</title></rect>\n";
+                if (row < cpus && boxWidth >= GANTT_LABEL_MIN_WIDTH) {
+                    text += "<text x=\"" + formatPixels(GANTT_LABEL_WIDTH + (box.start + box.end) * scale / 2) + "\" y=\"" + to_string(GANTT_MARGIN + row * GANTT_ROW_HEIGHT + GANTT_ROW_HEIGHT / 2 + 3) + "\" text-anchor=\"middle\" fill=\"white\">" + to_string(box.pid) + "</text>\n";
+                }
+            }
+            chart.append(text);
+        };
+        input.clear();
+        input.seekg(0);
+        for (string line; getline(input, line);) {
+            if (!parseGanttInterval(line, interval)) {
+                continue;
+            }
+            int row = interval.running ? max(interval.cpu, 0) : cpus;
+            GanttBox& box = boxes[row];
+            //Intervals are merged for as long as they all fit in a pixel, since they could not be told apart anyway
+            int start = min(box.start, interval.start);
+            int end = max(box.end, interval.end);
+            if (box.pending && (end - start) * scale <= 1) {
+                box.start = start;
+                box.end = end;
+                box.mixed = box.mixed || box.pid != interval.pid;
+                box.busy += interval.end - interval.start;
+                continue;
+            }
+            if (box.pending) {
+                draw(row, box);
+            }
+            box = GanttBox{true, interval.start, interval.end, interval.pid, false, interval.end - interval.start};
+        }
+        for (int row = 0; row < rows; row++) {
+            if (boxes[row].pending) {
+                draw(row, boxes[row]);
+            }
+        }
+        chart.append("</svg>\n");
+        if (html) {
+            chart.append("<p>Each CPU row shows the process it ran, gray where it was idle. Dark gray marks processes too short to draw apart, darker the busier it was. The IO row shows every process doing IO.</p>\n</body>\n</html>\n");
+        }
+        chart.flush();
+        if (chart.fail()) {
+            cout << "Unable to write chart file " << chartFile << endl;
+            exit(1);
+        }
+        chart.close();
+    }
+
+    //This is a row of the execution table as it was written
+    struct ExecutionRow {
+        int time = 0;
+        int pid = 0;
+        int cpu = 0; //0 when the table has no CPU column
+        MemoryStructures::ProcessState from = MemoryStructures::NOT_ARRIVED;
+        MemoryStructures::ProcessState to = MemoryStructures::NOT_ARRIVED;
+    };
+
+    static bool parseField(string_view text, int& value)
+    {
+        auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+        return error == errc() && end == text.data() + text.size();
+    }
+
+    static bool parseField(string_view text, MemoryStructures::ProcessState& state)
+    {
+        for (int s = MemoryStructures::NOT_ARRIVED; s <= MemoryStructures::TERMINATED; s++) {
+            if (MemoryStructures::STATE_NAMES[s] == text) {
+                state = (MemoryStructures::ProcessState) s;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * This function reads a row of the execution table
+     * @param begin - the start of the line
+     * @param end - the end of the line, without the newline
+     * @param row - where the row is read into
+     * @return false if the line is not a row, like the borders and the column names
+    */
+    static bool parseExecutionRow(const char* begin, const char* end, ExecutionRow& row)
+    {
+        if (begin == end || *begin != '|') {
+            return false;
+        }
+        //The fields are between the bars and padded with spaces
+        string_view fields[5];
+        size_t count = 0;
+        const char* field = begin + 1;
+        for (const char* c = field; c < end; c++) {
+            if (*c != '|') {
+                continue;
+            }
+            if (count == 5) {
+                return false;
+            }
+            string_view text(field, c - field);
+            text.remove_prefix(min(text.find_first_not_of(' '), text.size()));
+            text.remove_suffix(text.size() - (text.find_last_not_of(' ') + 1));
+            fields[count++] = text;
+            field = c + 1;
+        }
+        if (count != 4 && count != 5) {
+            return false;
+        }
+        row.cpu = 0;
+        return parseField(fields[0], row.time) && parseField(fields[1], row.pid) && (count == 4 || parseField(fields[2], row.cpu))
+            && parseField(fields[count - 2], row.from) && parseField(fields[count - 1], row.to);
+    }
+
+    /**
+     * This function maps a whole file into memory for reading. Exits the program if it cannot be read.
+     * @param fileName - the file
+     * @param length - set to the size of the file
+     * @return the contents, nullptr for an empty file. They are unmapped with munmap.
+    */
+    static const char* mapFile(string fileName, size_t& length)
+    {
+        int fd = open(fileName.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) < 0) {
+            cout << "Unable to open " << fileName << endl;
+            exit(1);
+        }
+        length = info.st_size;
+        if (length == 0) {
+            close(fd);
+            return nullptr;
+        }
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            cout << "Unable to map " << fileName << endl;
+            exit(1);
+        }
+        return (const char*) mapped;
+    }
+
+    string indexFilename(string tableFile)
+    {
+        return filesystem::path(tableFile).replace_extension(".idx").string();
+    }
+
+    void indexExecution(string tableFile, string indexFile)
+    {
+        size_t length;
+        const char* table = mapFile(tableFile, length);
+        if (table != nullptr) {
+            madvise((void*) table, length, MADV_SEQUENTIAL);
+        }
+        BufferedFile index;
+        if (!index.open(indexFile)) {
+            cout << "Unable to open index file " << indexFile << endl;
+            exit(1);
+        }
+        //The header is written again once the rows have been counted
+        IndexHeader header = {};
+        memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        header.version = INDEX_VERSION;
+        header.tableSize = length;
+        index.append((const char*) &header, sizeof(header));
+
+        unordered_map<int, IndexPid> pids;
+        vector<uint64_t> running; //the row that dispatched what each CPU is running
+        vector<vector<uint64_t>> checkpoints;
+        ExecutionRow row;
+        for (const char *line = table, *end; line < table + length; line = end + 1) {
+            end = (const char*) memchr(line, '\n', table + length - line);
+            if (end == nullptr) {
+                end = table + length;
+            }
+            if (!parseExecutionRow(line, end, row)) {
+                continue;
+            }
+            if (header.rows % INDEX_STRIDE == 0) {
+                checkpoints.push_back(running);
+            }
+            IndexPid& pid = pids.try_emplace(row.pid, IndexPid{row.pid, 0, NO_ROW}).first->second;
+            IndexRow indexed = {(uint64_t) (line - table), pid.last, row.time, row.pid};
+            index.append((const char*) &indexed, sizeof(indexed));
+            pid.last = header.rows;
+            pid.count++;
+            if ((size_t) row.cpu >= running.size()) {
+                running.resize(row.cpu + 1, NO_ROW);
+            }
+            if (row.to == MemoryStructures::RUNNING) {
+                running[row.cpu] = header.rows;
+            } else if (row.from == MemoryStructures::RUNNING) {
+                running[row.cpu] = NO_ROW;
+            }
+            header.rows++;
+        }
+        if (table != nullptr) {
+            munmap((void*) table, length);
+        }
+
+        //Every checkpoint has a row for every CPU, even the ones not used yet
+        header.cpus = max<size_t>(running.size(), 1);
+        for (vector<uint64_t>& checkpoint : checkpoints) {
+            checkpoint.resize(header.cpus, NO_ROW);
+            index.append((const char*) checkpoint.data(), checkpoint.size() * sizeof(uint64_t));
+        }
+        vector<IndexPid> sorted;
+        for (const auto& [pid, entry] : pids) {
+            sorted.push_back(entry);
+        }
+        sort(sorted.begin(), sorted.end(), [](const IndexPid& a, const IndexPid& b) { return a.pid < b.pid; });
+        index.append((const char*) sorted.data(), sorted.size() * sizeof(IndexPid));
+        header.pids = sorted.size();
+        index.flush();
+        if (index.fail()) {
+            cout << "Unable to write index file " << indexFile << endl;
+            exit(1);
+        }
+        index.close();
+        fstream file(indexFile, ios::in | ios::out | ios::binary);
+        file.write((const char*) &header, sizeof(header));
+        if (file.fail()) {
+            cout << "Unable to write index file " << indexFile << endl;
+            exit(1);
+        }
+    }
+
+    /**
+     * This function finds the line of the execution table a row starts
+     * @param table - the execution table
+     * @param length - its size
+     * @param offset - where the row starts
+     * @return the row with its newline, if it has one
+    */
+    static string_view rowText(const char* table, size_t length, uint64_t offset)
+    {
+        const char* line = table + offset;
+        const char* end = (const char*) memchr(line, '\n', table + length - line);
+        return string_view(line, (end == nullptr) ? table + length - line : end + 1 - line);
+    }
+
+    void queryExecution(string tableFile, string query)
+    {
+        string indexFile = indexFilename(tableFile);
+        size_t tableLength, indexLength;
+        const char* table = mapFile(tableFile, tableLength);
+        const char* index = mapFile(indexFile, indexLength);
+        IndexHeader header = {};
+        if (indexLength >= sizeof(header)) {
+            memcpy(&header, index, sizeof(header));
+        }
+        if (indexLength < sizeof(header) || memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || header.version != INDEX_VERSION) {
+            cout << indexFile << " is not an index this program can read." << endl;
+            exit(1);
+        }
+        uint64_t checkpointCount = (header.rows + INDEX_STRIDE - 1) / INDEX_STRIDE;
+        if (header.tableSize != tableLength || indexLength != sizeof(header) + header.rows * sizeof(IndexRow)
+                + checkpointCount * header.cpus * sizeof(uint64_t) + header.pids * sizeof(IndexPid)) {
+            cout << "The index does not match " << tableFile << ", it has changed since it was indexed. Index it again with --build-index." << endl;
+            exit(1);
+        }
+        const IndexRow* rows = (const IndexRow*) (index + sizeof(header));
+        const uint64_t* checkpoints = (const uint64_t*) (rows + header.rows);
+        const IndexPid* pids = (const IndexPid*) (checkpoints + checkpointCount * header.cpus);
+        auto before = [](const IndexRow& row, int time) { return row.time < time; };
+        auto after = [](int time, const IndexRow& row) { return time < row.time; };
+
+        string value = query.substr(query.find('=') + 1);
+        int first = 0, last = 0;
+        if (query.rfind("--at=", 0) == 0 && parseField(value, first)) {
+            //Start from the checkpoint before the time and replay the rows after it
+            uint64_t end = upper_bound(rows, rows + header.rows, first, after) - rows;
+            uint64_t checkpoint = min(end / INDEX_STRIDE, max<uint64_t>(checkpointCount, 1) - 1);
+            vector<uint64_t> running(header.cpus, NO_ROW);
+            if (checkpointCount > 0) {
+                running.assign(checkpoints + checkpoint * header.cpus, checkpoints + (checkpoint + 1) * header.cpus);
+            }
+            ExecutionRow row;
+            for (uint64_t r = checkpoint * INDEX_STRIDE; r < end; r++) {
+                string_view text = rowText(table, tableLength, rows[r].offset);
+                if (!parseExecutionRow(text.data(), text.data() + text.size() - (text.back() == '\n'), row) || (uint32_t) row.cpu >= header.cpus) {
+                    continue;
+                }
+                if (row.to == MemoryStructures::RUNNING) {
+                    running[row.cpu] = r;
+                } else if (row.from == MemoryStructures::RUNNING) {
+                    running[row.cpu] = NO_ROW;
+                }
+            }
+            cout << "At time " << first << ":\n";
+            for (uint32_t cpu = 0; cpu < header.cpus; cpu++) {
+                if (running[cpu] == NO_ROW) {
+                    cout << "CPU " << cpu << " is idle\n";
+                } else {
+                    cout << "CPU " << cpu << " is running PID " << rows[running[cpu]].pid << " since time " << rows[running[cpu]].time << '\n';
+                }
+            }
+        } else if (query.rfind("--range=", 0) == 0 && value.find(',') != string::npos
+                && parseField(string_view(value).substr(0, value.find(',')), first) && parseField(string_view(value).substr(value.find(',') + 1), last)) {
+            //The rows in a range of time are next to each other in the table, so they are written out in one piece
+            uint64_t begin = lower_bound(rows, rows + header.rows, first, before) - rows;
+            uint64_t end = upper_bound(rows, rows + header.rows, last, after) - rows;
+            if (begin >= end) {
+                cout << "No rows between time " << first << " and " << last << "." << endl;
+            } else {
+                string_view lastRow = rowText(table, tableLength, rows[end - 1].offset);
+                cout.write(table + rows[begin].offset, lastRow.data() + lastRow.size() - (table + rows[begin].offset));
+            }
+        } else if (query.rfind("--pid=", 0) == 0 && parseField(value, first)) {
+            const IndexPid* pid = lower_bound(pids, pids + header.pids, first, [](const IndexPid& entry, int pid) { return entry.pid < pid; });
+            if (pid == pids + header.pids || pid->pid != first) {
+                cout << "No rows for PID " << first << "." << endl;
+            } else {
+                //The rows are linked from the last one back
+                vector<uint64_t> history;
+                for (uint64_t r = pid->last; r < header.rows && history.size() < pid->count; r = rows[r].previous) {
+                    history.push_back(r);
+                }
+                for (auto r = history.rbegin(); r != history.rend(); r++) {
+                    cout << rowText(table, tableLength, rows[*r].offset);
+                }
+            }
+        } else {
+            cout << "Unknown query: " << query << endl;
+            exit(1);
+        }
+        cout.flush();
+        if (table != nullptr) {
+            munmap((void*) table, tableLength);
+        }
+        munmap((void*) index, indexLength);
+    }
+}
+
+namespace Metrics
+{
+    int Histogram::bucketOf(int value)
+    {
+        const int half = 1 << (SUB_BUCKET_BITS - 1);
+        if (value < (1 << SUB_BUCKET_BITS)) {
+            return value;
+        }
+        //Keep the top SUB_BUCKET_BITS bits of the value, the magnitude picks the set of buckets
+        int magnitude = 31 - __builtin_clz(value);
+        int shift = magnitude - SUB_BUCKET_BITS + 1;
+        return (magnitude - SUB_BUCKET_BITS + 2) * half + (value >> shift) - half;
+    }
+
+    int Histogram::highestIn(int bucket)
+    {
+        const int half = 1 << (SUB_BUCKET_BITS - 1);
+        if (bucket < (1 << SUB_BUCKET_BITS)) {
+            return bucket;
+        }
+        int shift = bucket / half - 1;
+        long lowest = (long) (bucket % half + half) << shift;
+        return (int) std::min<long>(lowest + (1l << shift) - 1, INT_MAX);
+    }
+
+    void Histogram::record(int value)
+    {
+        value = std::max(value, 0);
+        counts[bucketOf(value)]++;
+        total++;
+        maxValue = std::max(maxValue, value);
+    }
+
+    void Histogram::merge(const Histogram& other)
+    {
+        for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        maxValue = std::max(maxValue, other.maxValue);
+    }
+
+    void Histogram::save(Parsing::SnapshotWriter& snapshot) const
+    {
+        //Most buckets are empty, so only the others are written as bucket and count pairs
+        vector<unsigned long> used;
+        for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            if (counts[i] != 0) {
+                used.push_back(i);
+                used.push_back(counts[i]);
+            }
+        }
+        snapshot.putVector(used);
+        snapshot.put(total);
+        snapshot.put(maxValue);
+    }
+
+    void Histogram::restore(Parsing::SnapshotReader& snapshot)
+    {
+        vector<unsigned long> used = snapshot.getVector<unsigned long>();
+        counts.fill(0);
+        for (size_t i = 0; i + 1 < used.size(); i += 2) {
+            if (used[i] >= (unsigned long) HISTOGRAM_BUCKETS) {
+                cout << "Snapshot holds a histogram bucket that does not exist." << endl;
+                exit(1);
+            }
+            counts[used[i]] = used[i + 1];
+        }
+        total = snapshot.get<unsigned long>();
+        maxValue = snapshot.get<int>();
+    }
+
+    int Histogram::percentile(double percent) const
+    {
+        if (total == 0) {
+            return 0;
+        }
+        //The rank of the value wanted, counting from 1
+        unsigned long rank = std::max<unsigned long>(1, (unsigned long) ceil(percent / 100.0 * total));
+        unsigned long seen = 0;
+        for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return std::min(highestIn(i), maxValue);
+            }
+        }
+        return maxValue;
+    }
+
+    void LatencyHistograms::merge(const LatencyHistograms& other)
+    {
+        waitTime.merge(other.waitTime);
+        turnaroundTime.merge(other.turnaroundTime);
+        responseTime.merge(other.responseTime);
+    }
+
+    void Collector::reset(const vector<MemoryStructures::PcbEntry>& pcbTable, uint cpus)
+    {
+        cores.assign(cpus, CoreMetrics());
+        processes.assign(pcbTable.size(), ProcessMetrics());
+        for (size_t i = 0; i < pcbTable.size(); i++) {
+            processes[i].pid = pcbTable[i].pid;
+        }
+        lastTransition = 0;
+        transitionCount = 0;
+        completed = 0;
+        totalWaitTime = 0;
+        totalTurnaroundTime = 0;
+        totalResponseTime = 0;
+        latencies = LatencyHistograms();
+    }
+
+    void Collector::save(Parsing::SnapshotWriter& snapshot) const
+    {
+        snapshot.putVector(processes);
+        snapshot.put(lastTransition);
+        snapshot.put(transitionCount);
+        snapshot.put(completed);
+        snapshot.put(totalWaitTime);
+        snapshot.put(totalTurnaroundTime);
+        snapshot.put(totalResponseTime);
+        latencies.waitTime.save(snapshot);
+        latencies.turnaroundTime.save(snapshot);
+        latencies.responseTime.save(snapshot);
+        snapshot.putVector(cores);
+    }
+
+    void Collector::restore(Parsing::SnapshotReader& snapshot)
+    {
+        processes = snapshot.getVector<ProcessMetrics>();
+        lastTransition = snapshot.get<int>();
+        transitionCount = snapshot.get<unsigned long>();
+        completed = snapshot.get<uint>();
+        totalWaitTime = snapshot.get<long>();
+        totalTurnaroundTime = snapshot.get<long>();
+        totalResponseTime = snapshot.get<long>();
+        latencies.waitTime.restore(snapshot);
+        latencies.turnaroundTime.restore(snapshot);
+        latencies.responseTime.restore(snapshot);
+        cores = snapshot.getVector<CoreMetrics>();
+    }
+
+    void Collector::transition(size_t index, int time, MemoryStructures::ProcessState from, MemoryStructures::ProcessState to)
+    {
+        using namespace MemoryStructures;
+        ProcessMetrics& process = processes[index];
+        lastTransition = time;
+        transitionCount++;
+        //A process arrives when it leaves NEW, since that is when it gets its memory
+        if (from == NEW && process.arrivalTime == -1) {
+            process.arrivalTime = time;
+        }
+        if (to == READY) {
+            process.readySince = time;
+        } else if (to == RUNNING) {
+            if (process.startTime == -1) {
+                process.startTime = time;
+            }
+            process.waitingTime += time - process.readySince;
+        } else if (to == TERMINATED) {
+            process.completionTime = time;
+            //Everything about the process is final now, so it goes straight into the totals
+            if (process.arrivalTime != -1) {
+                int turnaroundTime = process.completionTime - process.arrivalTime;
+                int responseTime = (process.startTime == -1) ? 0 : process.startTime - process.arrivalTime;
+                completed++;
+                totalWaitTime += process.waitingTime;
+                totalTurnaroundTime += turnaroundTime;
+                totalResponseTime += responseTime;
+                latencies.waitTime.record(process.waitingTime);
+                latencies.turnaroundTime.record(turnaroundTime);
+                latencies.responseTime.record(responseTime);
+            }
+        }
+    }
+
+    void Collector::admit(size_t index, uint pid)
+    {
+        if (index >= processes.size()) {
+            processes.resize(index + 1);
+        }
+        processes[index] = ProcessMetrics();
+        processes[index].pid = pid;
+    }
+
+    void Collector::retire(size_t index)
+    {
+        processes[index] = ProcessMetrics();
+        processes[index].retired = true;
+    }
+
+    void Collector::dispatch(int core, bool stolen)
+    {
+        cores[core].dispatches++;
+        cores[core].steals += stolen;
+    }
+
+    Summary Collector::summarize() const
+    {
+        Summary summary = {};
+        summary.completed = completed;
+        summary.totalTime = lastTransition;
+        summary.throughput = (lastTransition > 0) ? (double) completed / lastTransition : 0;
+        if (completed > 0) {
+            summary.avgWaitTime = (double) totalWaitTime / completed;
+            summary.avgTurnaroundTime = (double) totalTurnaroundTime / completed;
+            summary.avgResponseTime = (double) totalResponseTime / completed;
+        }
+        return summary;
+    }
+
+    //Formats a number as briefly as it can be without losing precision
+    static string formatNumber(double value)
+    {
+        char digits[32];
+        auto [end, error] = to_chars(digits, digits + sizeof(digits), value);
+        return string(digits, end);
+    }
+
+    //Quotes a string for JSON
+    static string quote(string_view text)
+    {
+        string quoted = "\"";
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                quoted += '\\';
+            }
+            quoted += c;
+        }
+        return quoted + "\"";
+    }
+
+    void Collector::writeJson(string fileName, string inputFile, string strategy) const
+    {
+        ofstream output(fileName);
+        if (output.fail()) {
+            cout << "Unable to open metrics output file." << endl;
+            exit(1);
+        }
+        Summary summary = summarize();
+        output << "{\n";
+        output << "  \"file\": " << quote(inputFile) << ",\n";
+        output << "  \"strategy\": " << quote(strategy) << ",\n";
+        output << "  \"completed\": " << summary.completed << ",\n";
+        output << "  \"total_time\": " << summary.totalTime << ",\n";
+        output << "  \"throughput\": " << formatNumber(summary.throughput) << ",\n";
+        output << "  \"avg_wait_time\": " << formatNumber(summary.avgWaitTime) << ",\n";
+        output << "  \"avg_turnaround_time\": " << formatNumber(summary.avgTurnaroundTime) << ",\n";
+        output << "  \"avg_response_time\": " << formatNumber(summary.avgResponseTime) << ",\n";
+        output << "  \"percentiles\": {";
+        const pair<const char*, const Histogram*> times[] = {{"wait_time", &latencies.waitTime}, {"turnaround_time", &latencies.turnaroundTime}, {"response_time", &latencies.responseTime}};
+        for (int t = 0; t < 3; t++) {
+            output << (t == 0 ? "\n" : ",\n") << "    " << quote(times[t].first) << ": {";
+            for (int i = 0; i < 4; i++) {
+                output << quote(PERCENTILE_NAMES[i]) << ": " << times[t].second->percentile(REPORTED_PERCENTILES[i]) << ", ";
+            }
+            output << "\"max\": " << times[t].second->max() << "}";
+        }
+        output << "\n  },\n";
+        if (cores.size() > 1) {
+            //Utilization is the share of the run each CPU spent busy
+            unsigned long busyTime = 0;
+            output << "  \"cores\": [";
+            for (size_t c = 0; c < cores.size(); c++) {
+                const CoreMetrics& core = cores[c];
+                busyTime += core.busyTime;
+                output << (c == 0 ? "\n" : ",\n") << "    {\"cpu\": " << c << ", \"busy_time\": " << core.busyTime;
+                output << ", \"utilization\": " << formatNumber(summary.totalTime > 0 ? (double) core.busyTime / summary.totalTime : 0);
+                output << ", \"dispatches\": " << core.dispatches << ", \"steals\": " << core.steals << ", \"completed\": " << core.completed << "}";
+            }
+            output << "\n  ],\n";
+            output << "  \"utilization\": " << formatNumber(summary.totalTime > 0 ? (double) busyTime / summary.totalTime / cores.size() : 0) << ",\n";
+        }
+        output << "  \"processes\": [";
+        bool first = true;
+        for (const ProcessMetrics& p : processes) {
+            if (p.retired) {
+                continue;
+            }
+            bool done = p.arrivalTime != -1 && p.completionTime != -1;
+            output << (first ? "\n" : ",\n");
+            first = false;
+            output << "    {\"pid\": " << p.pid << ", \"arrival_time\": " << p.arrivalTime << ", \"start_time\": " << p.startTime;
+            output << ", \"completion_time\": " << p.completionTime << ", \"waiting_time\": " << p.waitingTime;
+            output << ", \"turnaround_time\": " << (done ? p.completionTime - p.arrivalTime : -1);
+            output << ", \"response_time\": " << ((p.startTime != -1 && p.arrivalTime != -1) ? p.startTime - p.arrivalTime : -1) << "}";
+        }
+        output << "\n  ]\n}\n";
+    }
+
+    void Collector::writeSummaryHeader(ostream& output)
+    {
+        output << ",completed,total_time,throughput,avg_wait_time,avg_turnaround_time,avg_response_time";
+        for (const char* name : {"wait_time", "turnaround_time", "response_time"}) {
+            for (const char* percentile : PERCENTILE_NAMES) {
+                output << "," << name << "_" << percentile;
+            }
+            output << "," << name << "_max";
+        }
+    }
+
+    void Collector::writeSummaryRow(ostream& output) const
+    {
+        Summary summary = summarize();
+        output << "," << summary.completed << "," << summary.totalTime << ",";
+        output << formatNumber(summary.throughput) << "," << formatNumber(summary.avgWaitTime) << ",";
+        output << formatNumber(summary.avgTurnaroundTime) << "," << formatNumber(summary.avgResponseTime);
+        for (const Histogram* histogram : {&latencies.waitTime, &latencies.turnaroundTime, &latencies.responseTime}) {
+            for (double percent : REPORTED_PERCENTILES) {
+                output << "," << histogram->percentile(percent);
+            }
+            output << "," << histogram->max();
+        }
+    }
+
+    void Collector::writeCsv(string summaryFileName, string processFileName, string inputFile, string strategy) const
+    {
+        ofstream summaryOutput(summaryFileName);
+        ofstream processOutput(processFileName);
+        if (summaryOutput.fail() || processOutput.fail()) {
+            cout << "Unable to open metrics output file." << endl;
+            exit(1);
+        }
+        summaryOutput << "file,strategy";
+        writeSummaryHeader(summaryOutput);
+        summaryOutput << "\n";
+        summaryOutput << inputFile << "," << strategy;
+        writeSummaryRow(summaryOutput);
+        summaryOutput << "\n";
+        processOutput << "pid,arrival_time,start_time,completion_time,waiting_time,turnaround_time,response_time\n";
+        for (const ProcessMetrics& p : processes) {
+            if (p.retired) {
+                continue;
+            }
+            bool done = p.arrivalTime != -1 && p.completionTime != -1;
+            processOutput << p.pid << "," << p.arrivalTime << "," << p.startTime << "," << p.completionTime << "," << p.waitingTime << ",";
+            processOutput << (done ? p.completionTime - p.arrivalTime : -1) << ",";
+            processOutput << ((p.startTime != -1 && p.arrivalTime != -1) ? p.startTime - p.arrivalTime : -1) << "\n";
+        }
+    }
+
+    void Collector::writeCoreCsv(string fileName) const
+    {
+        ofstream output(fileName);
+        if (output.fail()) {
+            cout << "Unable to open metrics output file." << endl;
+            exit(1);
+        }
+        Summary summary = summarize();
+        CoreMetrics all;
+        output << "cpu,busy_time,utilization,dispatches,steals,completed\n";
+        for (size_t c = 0; c < cores.size(); c++) {
+            const CoreMetrics& core = cores[c];
+            output << c << "," << core.busyTime << "," << formatNumber(summary.totalTime > 0 ? (double) core.busyTime / summary.totalTime : 0);
+            output << "," << core.dispatches << "," << core.steals << "," << core.completed << "\n";
+            all.busyTime += core.busyTime;
+            all.dispatches += core.dispatches;
+            all.steals += core.steals;
+            all.completed += core.completed;
+        }
+        output << "all," << all.busyTime << "," << formatNumber(summary.totalTime > 0 ? (double) all.busyTime / summary.totalTime / cores.size() : 0);
+        output << "," << all.dispatches << "," << all.steals << "," << all.completed << "\n";
+    }
+
+    void writePercentiles(string fileName, const vector<string>& strategies, const vector<LatencyHistograms>& histograms)
+    {
+        ofstream output(fileName);
+        if (output.fail()) {
+            cout << "Unable to open percentiles output file." << endl;
+            exit(1);
+        }
+        output << "strategy,time,count,p50,p90,p99,p999,max\n";
+        for (size_t s = 0; s < strategies.size(); s++) {
+            const pair<const char*, const Histogram*> times[] = {{"wait_time", &histograms[s].waitTime}, {"turnaround_time", &histograms[s].turnaroundTime}, {"response_time", &histograms[s].responseTime}};
+            for (auto& [name, histogram] : times) {
+                output << strategies[s] << "," << name << "," << histogram->count();
+                for (double percent : REPORTED_PERCENTILES) {
+                    output << "," << histogram->percentile(percent);
+                }
+                output << "," << histogram->max() << "\n";
+            }
+        }
+    }
+}
+
+namespace Profiling
+{
+    void addSample(SectionStats& stats, uint64_t ticks)
+    {
+        stats.sampledTicks += ticks;
+        stats.sampled++;
+        stats.reschedule();
+    }
+
+    void Profile::start()
+    {
+        //The cheapest of many back to back readings is the cost of timing an empty call
+        timerTicks = UINT64_MAX;
+        for (int i = 0; i < 1000; i++) {
+            uint64_t before = now();
+            timerTicks = min(timerTicks, now() - before);
+        }
+        startTime = chrono::steady_clock::now();
+        startTicks = now();
+    }
+
+    void Profile::writeJson(string fileName, string inputFile, string strategy) const
+    {
+        ofstream output(fileName);
+        if (output.fail()) {
+            cout << "Unable to open profile output file." << endl;
+            exit(1);
+        }
+        //The clock ticks are turned into nanoseconds by comparing them with the steady clock over the whole run
+        double wallTime = chrono::duration<double, nano>(chrono::steady_clock::now() - startTime).count();
+        uint64_t ticks = now() - startTicks;
+        double nanosPerTick = (ticks > 0) ? wallTime / ticks : 0;
+        output << "{\n";
+        output << "  \"file\": " << Metrics::quote(inputFile) << ",\n";
+        output << "  \"strategy\": " << Metrics::quote(strategy) << ",\n";
+        output << "  \"sample_rate\": " << SAMPLE_RATE << ",\n";
+        output << "  \"wall_time_ns\": " << (uint64_t) wallTime << ",\n";
+        output << "  \"sections\": {";
+        for (int s = 0; s < NUM_SECTIONS; s++) {
+            const SectionStats& section = sections[s];
+            //The timed calls stand for all of them, less what timing them cost
+            uint64_t ticks = section.sampledTicks - min(section.sampledTicks, section.sampled * timerTicks);
+            double time = (section.sampled > 0) ? (double) ticks * nanosPerTick * section.calls() / section.sampled : 0;
+            output << (s == 0 ? "\n" : ",\n") << "    " << Metrics::quote(SECTION_NAMES[s]) << ": {\"calls\": " << section.calls();
+            output << ", \"time_ns\": " << (uint64_t) time << ", \"share\": " << Metrics::formatNumber(wallTime > 0 ? time / wallTime : 0) << "}";
+        }
+        output << "\n  },\n";
+        output << "  \"queue_high_water\": {";
+        for (size_t state = 0; state < highWater.size(); state++) {
+            output << (state == 0 ? "" : ", ") << Metrics::quote(MemoryStructures::stateName((MemoryStructures::ProcessState) state)) << ": " << highWater[state];
+        }
+        output << "},\n";
+        output << "  \"failed_admissions\": " << failedAdmissions << "\n";
+        output << "}\n";
+    }
+}
+
+namespace Scan
+{
+    size_t countDueScalar(const int* times, size_t count, int now)
+    {
+        size_t due = 0;
+        while (due < count && times[due] <= now) {
+            due++;
+        }
+        return due;
+    }
+
+    int collectDueScalar(const int* times, size_t count, int now, vector<uint32_t>& due)
+    {
+        int earliest = INT_MAX;
+        for (size_t i = 0; i < count; i++) {
+            if (times[i] <= now) {
+                due.push_back(i);
+            } else {
+                earliest = min(earliest, times[i]);
+            }
+        }
+        return earliest;
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    //These compare eight times at once. They are compiled for AVX2 on their own, so the rest of the program
+    //still runs on a CPU without it.
+    __attribute__((target("avx2"))) static size_t countDueAvx2(const int* times, size_t count, int now)
+    {
+        __m256i limit = _mm256_set1_epi32(now);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i late = _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i*) (times + i)), limit);
+            int mask = _mm256_movemask_ps(_mm256_castsi256_ps(late));
+            if (mask != 0) {
+                return i + __builtin_ctz(mask);
+            }
+        }
+        return i + countDueScalar(times + i, count - i, now);
+    }
+
+    __attribute__((target("avx2"))) static int collectDueAvx2(const int* times, size_t count, int now, vector<uint32_t>& due)
+    {
+        __m256i limit = _mm256_set1_epi32(now);
+        __m256i never = _mm256_set1_epi32(INT_MAX);
+        __m256i earliest = never;
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i block = _mm256_loadu_si256((const __m256i*) (times + i));
+            __m256i late = _mm256_cmpgt_epi32(block, limit);
+            earliest = _mm256_min_epi32(earliest, _mm256_blendv_epi8(never, block, late));
+            for (int mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(late)) & 0xFF; mask != 0; mask &= mask - 1) {
+                due.push_back(i + __builtin_ctz(mask));
+            }
+        }
+        alignas(32) int lanes[8];
+        _mm256_store_si256((__m256i*) lanes, earliest);
+        int result = *min_element(lanes, lanes + 8);
+        for (; i < count; i++) {
+            if (times[i] <= now) {
+                due.push_back(i);
+            } else {
+                result = min(result, times[i]);
+            }
+        }
+        return result;
+    }
+#endif
+
+    bool usingAvx2()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+        return supported;
+#else
+        return false;
+#endif
+    }
+
+    size_t countDue(const int* times, size_t count, int now)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        if (usingAvx2()) {
+            return countDueAvx2(times, count, now);
+        }
+#endif
+        return countDueScalar(times, count, now);
+    }
+
+    int collectDue(const int* times, size_t count, int now, vector<uint32_t>& due)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        if (usingAvx2()) {
+            return collectDueAvx2(times, count, now, due);
+        }
+#endif
+        return collectDueScalar(times, count, now, due);
+    }
+}
+
+namespace Execution
+{
+    using namespace MemoryStructures;
+
+    void IoWaits::push(const IoCompletion& completion, int time)
+    {
+        if (completion.time - time < IO_WINDOW_TICKS) {
+            times.push_back(completion.time);
+            sequences.push_back(completion.sequence);
+            processes.push_back(completion.process);
+        } else {
+            later.push(completion);
+        }
+        count++;
+        earliest = min(earliest, completion.time);
+    }
+
+    void IoWaits::takeDue(int time, vector<IoCompletion>& finished)
+    {
+        finished.clear();
+        if (time < earliest) {
+            return;
+        }
+        int columnsEarliest = INT_MAX;
+        if (!times.empty()) {
+            due.clear();
+            columnsEarliest = Scan::collectDue(times.data(), times.size(), time, due);
+            for (uint32_t i : due) {
+                finished.push_back(IoCompletion{times[i], sequences[i], processes[i]});
+            }
+            //Fill each hole with the last entry, from the back so the last entry is never one still to be taken out
+            for (auto i = due.rbegin(); i != due.rend(); ++i) {
+                times[*i] = times.back();
+                sequences[*i] = sequences.back();
+                processes[*i] = processes.back();
+                times.pop_back();
+                sequences.pop_back();
+                processes.pop_back();
+            }
+            count -= due.size();
+        }
+        bool mixed = !finished.empty();
+        size_t fromColumns = finished.size();
+        while (!later.empty() && later.top().time <= time) {
+            finished.push_back(later.top());
+            later.pop();
+        }
+        count -= finished.size() - fromColumns;
+        earliest = min(columnsEarliest, later.empty() ? INT_MAX : later.top().time);
+        //The heap gives its IO in order, so only IO from the columns needs putting in place
+        if (mixed) {
+            sort(finished.begin(), finished.end(), [](const IoCompletion& a, const IoCompletion& b) { return b > a; });
+        }
+    }
+
+    vector<IoCompletion> IoWaits::pending() const
+    {
+        vector<IoCompletion> all;
+        all.reserve(count);
+        for (size_t i = 0; i < times.size(); i++) {
+            all.push_back(IoCompletion{times[i], sequences[i], processes[i]});
+        }
+        auto heap = later;
+        while (!heap.empty()) {
+            all.push_back(heap.top());
+            heap.pop();
+        }
+        sort(all.begin(), all.end(), [](const IoCompletion& a, const IoCompletion& b) { return b > a; });
+        return all;
+    }
+
+    template <typename Policy>
+    bool SimulatorImpl<Policy>::reserveMemory(uint size, pcb_t* process)
+    {
+        PROFILE_SCOPE(RESERVE_MEMORY);
+        Partition* partition = memory->allocate(size, process->pid);
+        if (partition == nullptr) {
+            return false;
+        }
+        process->memoryAllocated = partition;
+        memoryGeneration++;
+        return true;
+    } 
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::releaseMemory(pcb_t* process)
+    {
+        memory->release(process->memoryAllocated);
+        process->memoryAllocated = nullptr;
+        memoryGeneration++;
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::loadMemory() {
+        PROFILE_SCOPE(LOAD_MEMORY);
+        //Iterate through every single process in the new state
+        while (!pcb[1].empty()) {
+            
+            //First check if there is space
+            if (!memory->hasFree()) {
+                break; //leave the loop
+            }
+            //Next decide what processes to load into memory - this is where scheduling strategy comes into play
+            ExecutionOrder order = getExecutionOrder(NEW);
+            if (order.process == nullptr) {
+                break;
+            }
+            //Load that process into memory reservememory()
+            if (reserveMemory(order.process->memorySize, order.process)) {
+                changeState(order.process, NEW, READY);
+                writeMemoryStatus(order.process->memorySize);
+            } else {
+                //temporariily change the state to not ready
+                PROFILE_COUNT(failedAdmissions);
+                blockOnMemory(order.process);
+            }
+        }
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::moveProcess(pcb_t* process, ProcessState finalState, bool toFront) {
+        pcb[process->state].remove(process);
+        dequeueProcess(process);
+        process->state = finalState;
+        if (toFront) {
+            pcb[finalState].push_front(process);
+        } else {
+            pcb[finalState].push_back(process);
+        }
+        PROFILE_QUEUE(finalState, pcb[finalState].size());
+        queueProcess(process, finalState);
+    }
+
+    template <typename Policy>
+    ExecutionOrder SimulatorImpl<Policy>::getExecutionOrder(ProcessState state) {
+        return getExecutionOrder(schedulingQueues[state], pcb[state].size());
+    }
+
+    template <typename Policy>
+    ExecutionOrder SimulatorImpl<Policy>::getExecutionOrder(SchedulingQueue& queue, size_t waiting) {
+        PROFILE_SCOPE(GET_EXECUTION_ORDER);
+        ExecutionOrder order;
+        pcb_t* process = frontOf(queue);
+        if (process != nullptr) {
+            order.process = process;
+            order.time = policy.slice(process, waiting);
+        }
+        return order;
+    }
+
+    template <typename Policy>
+    bool SimulatorImpl<Policy>::shouldPreempt(SchedulingQueue& queue, const pcb_t* running) {
+        pcb_t* ready = frontOf(queue);
+        return ready != nullptr && policy.preempts(ready, running);
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::queueProcess(pcb_t* process, ProcessState state) {
+        if (state != NEW && state != READY) {
+            return;
+        }
+        if (state == READY) {
+            policy.becameReady(process);
+        }
+        process->queueTicket = nextTicket++;
+        QueueEntry entry{policy.key(process, state), process->queueTicket, process};
+        if (state == READY && !cores.empty()) {
+            //Processes go back to the CPU they last ran on
+            if (process->core < 0) {
+                process->core = leastLoadedCore();
+            }
+            cores[process->core].readyQueue.push(entry);
+            cores[process->core].queued++;
+            return;
+        }
+        schedulingQueues[state].push(entry);
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::boostPriorities() {
+        if (!policy.boostDue(timer)) {
+            return;
+        }
+        for (int state = NEW; state < TERMINATED; state++) {
+            for (pcb_t* process : pcb[state]) {
+                policy.boost(process);
+            }
+        }
+        //Take the ready processes out front first so they keep their order between themselves
+        vector<pcb_t*> ready;
+        ready.reserve(pcb[READY].size());
+        auto drain = [&](SchedulingQueue& queue) {
+            while (pcb_t* process = frontOf(queue)) {
+                queue.pop();
+                ready.push_back(process);
+            }
+        };
+        if (cores.empty()) {
+            drain(schedulingQueues[READY]);
+        }
+        for (Core& core : cores) {
+            drain(core.readyQueue);
+            core.queued = 0;
+        }
+        for (pcb_t* process : ready) {
+            queueProcess(process, READY);
+        }
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::dequeueProcess(pcb_t* process) {
+        if (!cores.empty() && process->state == READY && process->queueTicket != 0) {
+            cores[process->core].queued--;
+        }
+        //The entry stays in the heap until it reaches the front and is found to be stale
+        process->queueTicket = 0;
+    }
+
+    template <typename Policy>
+    pcb_t* SimulatorImpl<Policy>::frontOf(SchedulingQueue& queue) {
+        while (!queue.empty() && queue.top().ticket != queue.top().process->queueTicket) {
+            queue.pop();
+        }
+        return queue.empty() ? nullptr : queue.top().process;
+    }
+
+    template <typename Policy>
+    bool SimulatorImpl<Policy>::processesRemain() {
+        bool allNotTerminated = false;
+        for (int i = NOT_ARRIVED ; i < TERMINATED ; i++) {
+            if (!pcb[i].empty()) {
+                allNotTerminated = true;
+                break;
+            }
+        }
+        bool memoryNotDeallocated = memory->inUse();
+        return (allNotTerminated) || (memoryNotDeallocated); ;
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::setOutputFiles(std::string executionFileName, std::string memoryStatusFileName, bool background)
+    {
+        traceOutput.open(executionFileName, memoryStatusFileName, background);
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::writeExecutionStep(pcb_t* process, ProcessState currentState ,ProcessState nextState)
+    {
+        PROFILE_SCOPE(EXECUTION_WRITER);
+        if (traceOutput.executionFailed())
+        {
+            return;
+        }
+        traceOutput.executionStep(timer, process->pid, currentState, nextState, cores.empty() ? -1 : process->core);
+    }
+
+    //Appends a number to a string without building a temporary string for it
+    static void appendNumber(string& text, long value)
+    {
+        char digits[24];
+        auto [end, error] = to_chars(digits, digits + sizeof(digits), value);
+        text.append(digits, end - digits);
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::writeMemoryStatus(int memAllocated)
+    {
+        PROFILE_SCOPE(MEMORY_STATUS_WRITER);
+        if (traceOutput.memoryStatusFailed())
+        {
+            return;
+        }
+        //Free memory is counted as partitions are reserved and released. The total also includes the part of
+        //every partition that its owner does not need.
+        int usableFreeMemory = memory->freeMemory;
+        int totalFreeMemory = memory->totalSize - memory->usedMemory;
+        //Get the memory state, into the same string every time so it is only allocated while it grows
+        memoryState.clear();
+        if (memory->mode == FIXED) {
+            memoryState.reserve(memory->partitions.size() * 4);
+            for (Partition& partition : memory->partitions)
+            {
+                appendNumber(memoryState, partition.code);
+                memoryState += ',';
+            }
+        } else {
+            //List the blocks and the holes between them in address order as code:size
+            memoryState.reserve(memory->blocks.size() * 16 + 16);
+            uint address = 0;
+            for (auto& [start, partition] : memory->blocks) {
+                if (start > address) {
+                    memoryState += "-1:";
+                    appendNumber(memoryState, start - address);
+                    memoryState += ',';
+                }
+                appendNumber(memoryState, partition.code);
+                memoryState += ':';
+                appendNumber(memoryState, partition.size);
+                memoryState += ',';
+                address = start + partition.size;
+            }
+            if (address < memory->totalSize) {
+                memoryState += "-1:";
+                appendNumber(memoryState, memory->totalSize - address);
+                memoryState += ',';
+            }
+        }
+        if (!memoryState.empty()) {
+            memoryState.pop_back();
+        }
+        //External fragmentation is the share of free memory that is not in the largest hole
+        double fragmentation = 0;
+        if (memory->mode != FIXED && usableFreeMemory != 0) {
+            fragmentation = 100.0 * (1.0 - (double) memory->largestFree() / usableFreeMemory);
+        }
+        traceOutput.memoryStatusLine(timer, memAllocated, memoryState, totalFreeMemory, usableFreeMemory, memory->mode != FIXED, fragmentation);
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::writeHeaders() {
+        //Execution output header, with a CPU column when there are several
+        if (cores.empty()) {
+            traceOutput.executionText("+------------------------------------------------+");
+            traceOutput.executionText("|Time of Transition |PID | Old State | New State |");
+            traceOutput.executionText("+------------------------------------------------+");
+        } else {
+            traceOutput.executionText("+------------------------------------------------------+");
+            traceOutput.executionText("|Time of Transition |PID | CPU | Old State | New State |");
+            traceOutput.executionText("+------------------------------------------------------+");
+        }
+        //Memory Status output header
+        if (memory->mode == FIXED) {
+            traceOutput.memoryText("+------------------------------------------------------------------------------------------+");
+            traceOutput.memoryText("| Time of Event | Memory Used | Partitions State | Total Free Memory | Usable Free Memory |");
+            traceOutput.memoryText("+------------------------------------------------------------------------------------------+");
+        } else {
+            traceOutput.memoryText("+-------------------------------------------------------------------------------------------------------------------+");
+            traceOutput.memoryText("| Time of Event | Memory Used | Partitions State | Total Free Memory | Usable Free Memory | External Fragmentation |");
+            traceOutput.memoryText("+-------------------------------------------------------------------------------------------------------------------+");
+        }
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::writeFooters() {
+        if (memory->mode == FIXED) {
+            traceOutput.memoryText("+------------------------------------------------------------------------------------------+");
+        } else {
+            traceOutput.memoryText("+-------------------------------------------------------------------------------------------------------------------+");
+        }
+        traceOutput.executionText(cores.empty() ? "+------------------------------------------------+" : "+------------------------------------------------------+");
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::checkArrived() {
+        PROFILE_SCOPE(CHECK_ARRIVED);
+        //Retry the processes that are blocked on memory. Without a change in memory they would all fail again
+        //and end up in reverse order, so only that is recorded. The same goes when not even the smallest of them fits.
+        if (pcb[NOT_ARRIVED].front() != nextArrival) {
+            if (retryPending() && !(pcb[NEW].empty() && memory->hasFree() && !memory->fits(blockedMinSize))) {
+                restoreBlockedOrder();
+                blockedMinSize = UINT_MAX;
+                unsigned long skipped = 0; //added to the profile once the loop is done, so the loop does not write to it
+                //Processes that still do not fit are put back at the front, so they are not visited again
+                for (pcb_t *p = pcb[NOT_ARRIVED].front(), *next; p != nextArrival; p = next) {
+                    next = p->next;
+                    if (pcb[NEW].empty() && memory->hasFree() && !memory->fits(p->memorySize)) {
+                        //Loading it on its own would fail, so skip the trip through NEW
+                        skipped++;
+                        pcb[NOT_ARRIVED].remove(p);
+                        pcb[NOT_ARRIVED].push_front(p);
+                        blockedMinSize = min(blockedMinSize, p->memorySize);
+                        continue;
+                    }
+                    moveProcess(p, NEW);
+                    loadMemory();
+                }
+                PROFILE_ADD(failedAdmissions, skipped);
+            } else {
+                blockedReversed = !blockedReversed;
+            }
+        }
+        //Then admit everything that arrives on this tick, the arrival times are in the same order as the list
+        while (size_t due = Scan::countDue(arrivalTimes.data() + arrivalCursor, arrivalTimes.size() - arrivalCursor, timer)) {
+            for (; due > 0; due--) {
+                pcb_t* p = nextArrival;
+                nextArrival = p->next;
+                arrivalCursor++;
+                //change state without printing
+                moveProcess(p, NEW);
+                loadMemory();
+                //A streamed process is only read once the one before it has arrived
+                if (nextArrival == nullptr && workloadStream) {
+                    streamProcess();
+                }
+            }
+        }
+        retryGeneration = memoryGeneration;
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::sortArrivals() {
+        //Sorting the times with the processes keeps the sort from reading every process, and gives the arrival column
+        vector<pair<int, pcb_t*>> arrivals;
+        arrivals.reserve(pcb[NOT_ARRIVED].size());
+        while (!pcb[NOT_ARRIVED].empty()) {
+            arrivals.push_back({(int) pcb[NOT_ARRIVED].front()->arrivalTime, pcb[NOT_ARRIVED].front()});
+            pcb[NOT_ARRIVED].remove(pcb[NOT_ARRIVED].front());
+        }
+        stable_sort(arrivals.begin(), arrivals.end(), [](const pair<int, pcb_t*>& a, const pair<int, pcb_t*>& b) { return a.first < b.first; });
+        arrivalTimes.clear();
+        arrivalCursor = 0;
+        for (auto& [time, p] : arrivals) {
+            pcb[NOT_ARRIVED].push_back(p);
+            arrivalTimes.push_back(time);
+        }
+        nextArrival = pcb[NOT_ARRIVED].front();
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::indexArrivals() {
+        arrivalTimes.clear();
+        arrivalCursor = 0;
+        for (pcb_t* p = nextArrival; p != nullptr; p = p->next) {
+            arrivalTimes.push_back(p->arrivalTime);
+        }
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::streamProcess() {
+        pcb_t process = {};
+        if (!workloadStream->next(process)) {
+            workloadStream.reset();
+            return;
+        }
+        pcb_t* p;
+        if (freeSlots.empty()) {
+            process.slot = streamSlots.size();
+            p = &streamSlots.emplace_back();
+        } else {
+            p = freeSlots.back();
+            freeSlots.pop_back();
+            process.slot = p->slot;
+        }
+        *p = process;
+        p->state = NOT_ARRIVED;
+        p->core = -1;
+        pcb[NOT_ARRIVED].push_back(p);
+        metricsCollector.admit(p->slot, p->pid);
+        nextArrival = p;
+        //Only one streamed process is waiting to arrive at a time, so the arrival times never grow past one
+        arrivalTimes.assign(1, p->arrivalTime);
+        arrivalCursor = 0;
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::retire(pcb_t* process) {
+        if (!options.stream) {
+            return;
+        }
+        pcb[TERMINATED].remove(process);
+        metricsCollector.retire(process->slot);
+        freeSlots.push_back(process);
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::blockOnMemory(pcb_t* process) {
+        restoreBlockedOrder();
+        blockedMinSize = min(blockedMinSize, process->memorySize);
+        moveProcess(process, NOT_ARRIVED, true);
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::restoreBlockedOrder() {
+        if (!blockedReversed) {
+            return;
+        }
+        //Pushing the blocked processes back onto the front one at a time reverses them
+        vector<pcb_t*> blocked;
+        while (pcb[NOT_ARRIVED].front() != nextArrival) {
+            blocked.push_back(pcb[NOT_ARRIVED].front());
+            pcb[NOT_ARRIVED].remove(pcb[NOT_ARRIVED].front());
+        }
+        for (pcb_t* p : blocked) {
+            pcb[NOT_ARRIVED].push_front(p);
+        }
+        blockedReversed = false;
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::doIO() {
+        PROFILE_SCOPE(DO_IO);
+        //Move every process whose IO finishes by now to the ready state, in the order they started waiting
+        if (ioWaits.earliest > timer) {
+            return;
+        }
+        ioWaits.takeDue(timer, finishedIO);
+        for (const IoCompletion& completion : finishedIO) {
+            changeState(completion.process, WAITING, READY);
+        }
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::startIO(pcb_t* process) {
+        //IO is checked on the tick after the process starts waiting at the earliest
+        process->ioCompletionTime = timer + max((int) process->ioDuration, 1);
+        ioWaits.push(IoCompletion{(int) process->ioCompletionTime, nextIoSequence++, process}, timer);
+    }
+
+    template <typename Policy>
+    bool SimulatorImpl<Policy>::doExecution()
+    {   
+        // We need to choose a process to run.
+        if (frontOf(schedulingQueues[READY]) != nullptr) {
+            boostPriorities();
+        }
+        ExecutionOrder order = getExecutionOrder(READY);
+
+        //Check if there is a process to run
+        if (order.process != nullptr) {
+            //Determine the next state of the process
+            ProcessState nextState = READY;
+            if (order.time >= (int) order.process->ioFrequency) {
+                nextState = WAITING;
+                order.time = order.process->ioFrequency;
+            }
+            if (((int) order.process->totalCPUTime - order.time) <= 0) {
+                nextState = TERMINATED;
+                order.time = order.process->totalCPUTime;
+            }
+            changeState(order.process, READY, RUNNING);
+            scheduleEvent(timer + order.time, (nextState == READY) ? QUANTUM_EXPIRY : BURST_END);
+            //Increment the timer while checking for any processes that have arrived or finished IO
+            int start = timer;
+            advanceClock(timer + order.time, order.process);
+            bool preempted = timer < start + order.time;
+            if (preempted) {
+                nextState = READY;
+            }
+            policy.burstEnded(order.process, timer - start, nextState == READY && !preempted);
+            changeState(order.process, RUNNING, nextState);
+            if (nextState == WAITING) {
+                startIO(order.process);
+            }
+            if (nextState == TERMINATED) {
+                releaseMemory(order.process);
+                writeMemoryStatus(order.process->memorySize);
+                loadMemory();
+                retire(order.process);
+            }
+        } else {
+            //Nothing is ready, so wait until something happens
+            int next = timer + 1;
+            if (eventDriven) {
+                next = nextEventTime();
+                if (next < 0) {
+                    return false;
+                }
+            }
+            advanceClock(next, nullptr);
+        }
+        return true;
+    }
+
+    template <typename Policy>
+    bool SimulatorImpl<Policy>::doMultiCoreExecution()
+    {
+        //Every idle CPU takes work first, lowest CPU first
+        for (int c = 0; c < (int) cores.size(); c++) {
+            if (cores[c].running == nullptr) {
+                dispatch(c);
+            }
+        }
+        //Run until the first burst ends. An idle CPU can pick up work whenever something becomes ready, and with a
+        //preemptive policy a running process can lose its CPU, so in either case the clock only moves a single step.
+        int target = -1;
+        bool idle = false;
+        for (Core& core : cores) {
+            if (core.running == nullptr) {
+                idle = true;
+            } else if (target < 0 || core.sliceEnd < target) {
+                target = core.sliceEnd;
+            }
+        }
+        if (idle || Policy::preemptive) {
+            int next = timer + 1;
+            if (eventDriven) {
+                next = nextEventTime();
+                if (next < 0 && target < 0) {
+                    return false;
+                }
+            }
+            if (next >= 0 && (target < 0 || next < target)) {
+                target = next;
+            }
+        }
+        int start = timer;
+        advanceClock(target, nullptr);
+        for (Core& core : cores) {
+            if (core.running != nullptr) {
+                core.running->totalCPUTime -= timer - start;
+            }
+        }
+        //End the bursts that are over, lowest CPU first
+        for (int c = 0; c < (int) cores.size(); c++) {
+            if (cores[c].running != nullptr && cores[c].sliceEnd <= timer) {
+                finishBurst(c);
+            }
+        }
+        if constexpr (Policy::preemptive) {
+            for (int c = 0; c < (int) cores.size(); c++) {
+                if (cores[c].running != nullptr && shouldPreempt(cores[c].readyQueue, cores[c].running)) {
+                    preempt(c);
+                }
+            }
+        }
+        return true;
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::dispatch(int c)
+    {
+        Core& core = cores[c];
+        Core* owner = &core; //the CPU whose queue the process is taken from
+        bool stolen = false;
+        if (frontOf(core.readyQueue) == nullptr) {
+            //Steal from the CPU with the most processes waiting
+            int victim = -1;
+            for (int v = 0; v < (int) cores.size(); v++) {
+                if (v != c && cores[v].queued > 0 && (victim < 0 || cores[v].queued > cores[victim].queued)) {
+                    victim = v;
+                }
+            }
+            if (victim < 0) {
+                return;
+            }
+            owner = &cores[victim];
+            stolen = true;
+        }
+        boostPriorities();
+        ExecutionOrder order = getExecutionOrder(owner->readyQueue, owner->queued);
+        //Determine the next state of the process the same way a single CPU does
+        ProcessState nextState = READY;
+        if (order.time >= (int) order.process->ioFrequency) {
+            nextState = WAITING;
+            order.time = order.process->ioFrequency;
+        }
+        if (((int) order.process->totalCPUTime - order.time) <= 0) {
+            nextState = TERMINATED;
+            order.time = order.process->totalCPUTime;
+        }
+        //Take the process off its queue before it moves, so the execution log shows the CPU it runs on
+        dequeueProcess(order.process);
+        order.process->core = c;
+        changeState(order.process, READY, RUNNING);
+        core.running = order.process;
+        core.sliceStart = timer;
+        core.sliceEnd = timer + order.time;
+        core.nextState = nextState;
+        scheduleEvent(core.sliceEnd, (nextState == READY) ? QUANTUM_EXPIRY : BURST_END);
+        metricsCollector.dispatch(c, stolen);
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::finishBurst(int c)
+    {
+        Core& core = cores[c];
+        pcb_t* process = core.running;
+        core.running = nullptr;
+        metricsCollector.coreRan(c, timer - core.sliceStart);
+        policy.burstEnded(process, timer - core.sliceStart, core.nextState == READY);
+        changeState(process, RUNNING, core.nextState);
+        if (core.nextState == WAITING) {
+            startIO(process);
+        }
+        if (core.nextState == TERMINATED) {
+            metricsCollector.coreCompleted(c);
+            releaseMemory(process);
+            writeMemoryStatus(process->memorySize);
+            loadMemory();
+            retire(process);
+        }
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::preempt(int c)
+    {
+        Core& core = cores[c];
+        pcb_t* process = core.running;
+        core.running = nullptr;
+        metricsCollector.coreRan(c, timer - core.sliceStart);
+        policy.burstEnded(process, timer - core.sliceStart, false);
+        changeState(process, RUNNING, READY);
+    }
+
+    template <typename Policy>
+    int SimulatorImpl<Policy>::leastLoadedCore()
+    {
+        int best = 0;
+        uint bestLoad = UINT_MAX;
+        for (int c = 0; c < (int) cores.size(); c++) {
+            uint load = cores[c].queued + (cores[c].running != nullptr);
+            if (load < bestLoad) {
+                best = c;
+                bestLoad = load;
+            }
+        }
+        return best;
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::scheduleEvent(int time, EventKind kind) {
+        if (eventDriven && time > timer) {
+            eventQueue.push(Event{time, kind});
+        }
+    }
+
+    template <typename Policy>
+    int SimulatorImpl<Policy>::nextEventTime() {
+        if (retryPending()) {
+            return timer + 1;
+        }
+        //Throw away anything that has already happened
+        while (!eventQueue.empty() && eventQueue.top().time <= timer) {
+            eventQueue.pop();
+        }
+        int next = eventQueue.empty() ? -1 : eventQueue.top().time;
+        if (!ioWaits.empty() && (next < 0 || ioWaits.earliest < next)) {
+            next = ioWaits.earliest;
+        }
+        if (arrivalCursor < arrivalTimes.size() && (next < 0 || arrivalTimes[arrivalCursor] < next)) {
+            next = arrivalTimes[arrivalCursor];
+        }
+        return next;
+    }
+
+    template <typename Policy>
+    bool SimulatorImpl<Policy>::retryPending() {
+        //The blocked processes are the ones in front of the next arrival
+        if (pcb[NOT_ARRIVED].front() == nextArrival) {
+            return false;
+        }
+        if (memoryGeneration != retryGeneration) {
+            return true;
+        }
+        //With no free partition the blocked processes get moved into NEW on the next tick
+        return !memory->hasFree();
+    }
 
-            stringstream ss(text);
-            string s;
-            try
-            {
-                getline(ss, s, ' '); // First parameter Pid
-                newProcess->pid = stoi(s);
-                getline(ss, s, ' ');
-                newProcess->memorySize = stoi(s);
-                getline(ss, s, ' ');
-                newProcess->arrivalTime = stoi(s);
-                getline(ss, s, ' ');
-                newProcess->totalCPUTime = stoi(s);
-                getline(ss, s, ' ');
-                newProcess->ioFrequency = stoi(s);
-                getline(ss, s, ' ');
-                newProcess->ioDuration = stoi(s);
-                newProcess->waitedTime = 0;
-            }
-            catch (const exception &e)
-            {
-                cerr << e.what() << '\n';
-                exit(1);
-            }
-            pcbTable.push_back(newProcess);
+    template <typename Policy>
+    void SimulatorImpl<Policy>::tick(pcb_t* running) {
+        timer += 1;
+        if (running != nullptr) {
+            running->totalCPUTime -= 1;
+        }
+        checkArrived();
+        doIO();
+    }
 
+    template <typename Policy>
+    void SimulatorImpl<Policy>::skipTicks(int count, pcb_t* running) {
+        if (count <= 0) {
+            return;
+        }
+        timer += count;
+        if (running != nullptr) {
+            running->totalCPUTime -= count;
+        }
+        //Each skipped tick retries the blocked processes, which reverses their order without changing anything else.
+        //Two retries cancel out so only the parity matters.
+        if (count % 2 == 1 && pcb[NOT_ARRIVED].front() != nextArrival) {
+            blockedReversed = !blockedReversed;
         }
-    
-        input.close();
-        return pcbTable;
     }
 
-    deque<string> grabStudentNumbers(string fileName)
-    {
-        deque<string> ids;
-        stringstream ss(fileName.substr(0, fileName.find_first_of('.')));
-        string s;
-        while (getline(ss, s, '_'))
-        { // while for any args
-            bool isStudentId = true;
-            // Check if the argument is a string or an integer
-            for (int i = 0; i < strlen(s.c_str()); i++)
-            {
-                if (!isdigit(s[i]))
-                {
-                    isStudentId = false;
-                    break;
+    template <typename Policy>
+    void SimulatorImpl<Policy>::advanceClock(int target, pcb_t* running) {
+        while (timer < target) {
+            if (eventDriven) {
+                int next = nextEventTime();
+                if (next < 0 || next > target) {
+                    next = target;
                 }
+                skipTicks(next - timer - 1, running);
             }
-            if (isStudentId) {
-                ids.push_back(s);
+            tick(running);
+            if constexpr (Policy::preemptive) {
+                if (running != nullptr && timer < target && shouldPreempt(schedulingQueues[READY], running)) {
+                    return;
+                }
             }
         }
-        return ids;
     }
 
-    string getOutputFilename(string prefix, string fileName) {
-        deque<string> studentNums = grabStudentNumbers(fileName);
-        string outputName = prefix;
-        for (string s : studentNums) {
-            outputName += ("_" + s);
+    template <typename Policy>
+    bool SimulatorImpl<Policy>::changeState(pcb_t* process, ProcessState initialState, ProcessState finalState) {
+        PROFILE_SCOPE(CHANGE_STATE);
+        if (process->state != initialState) {
+            return false;
         }
-        outputName += ".txt";
-        return outputName;
+        moveProcess(process, finalState);
+        writeExecutionStep(process, initialState, finalState);
+        if (initialState == RUNNING || initialState == WAITING) {
+            ganttOutput.interval(process->pid, initialState, process->stateSince, timer, (initialState == RUNNING && !cores.empty()) ? process->core : -1);
+        }
+        process->stateSince = timer;
+        metricsCollector.transition(process->slot, timer, initialState, finalState);
+        for (const TransitionCallback& callback : transitionCallbacks) {
+            callback(*process, initialState, finalState, timer);
+        }
+        return true;
     }
-}
 
-namespace Execution
-{
-    using namespace MemoryStructures;
+    template <typename Policy>
+    SimulatorImpl<Policy>::SimulatorImpl(const Parsing::Options& options, std::string outputDirectory)
+        : SimulatorImpl(options, options.stream ? std::vector<pcb_t>() : Parsing::loadPCBTable(options.inputFile), outputDirectory)
+    {
+    }
 
-    bool reserveMemory(Partition *memory, uint size, pcb_t* process)
+    template <typename Policy>
+    SimulatorImpl<Policy>::SimulatorImpl(const Parsing::Options& options, std::vector<pcb_t> workload, std::string outputDirectory)
+        : options(options), pcbTable(std::move(workload)), outputDirectory(outputDirectory)
     {
-        //*NOTE Partition sizes are ordered from largest to smallest - so best fit will be easy.
-        //*That means however, this method may need to be updated in the future if different partitions are given.
-        for (int i = PARTITION_NUM - 1; i >= 0; i--)
-        {
-            if (memory[i].code == -1)
-            {
-                if (size <= memory[i].size)
-                {
-                    memory[i].code = process->pid;
-                    process->memoryAllocated = &memory[i];
-                    return true;
-                }
+        //Set the output
+        if (options.traceFiles) {
+            setOutputFiles(outputFilename("execution"), outputFilename("memory_status"), options.asyncTrace);
+        }
+        if (options.gantt) {
+            ganttOutput.open(outputFilename("gantt", ".csv"), options.cpus > 1);
+        }
+        eventDriven = options.eventDriven;
+        policy.configure(options);
+
+        // Initialize memory partitions with the proper sizes.
+        if (options.memoryMode == FIXED) {
+            memory = new Memory(options.partitionSizes);
+        } else {
+            uint memorySize = options.memorySize;
+            for (uint size : options.partitionSizes) {
+                memorySize += (options.memorySize == 0) ? size : 0;
             }
+            memory = new Memory(options.memoryMode, memorySize);
         }
-        return false;
-    } 
+        //A single CPU keeps the original loop, so the cores are only made when there are several
+        if (options.cpus > 1) {
+            cores.resize(options.cpus);
+        }
+        //Print the headers of both files
+        writeHeaders();
 
-    void loadMemory(deque<pcb_t*>* pcb, Partition* memory) {
-        //Iterate through every single process in the new state
-        while (!pcb[1].empty()) {
-            
-            //First check if there is space
-            bool isSpace = false;
-            for (int i = 0 ; i < PARTITION_NUM ; i++) {
-                if (memory[i].code == -1) {
-                    isSpace = true;
+        // Initialize the PCB table
+        for (pcb_t& p : pcbTable) { // Initialize pcb entry
+            p.slot = &p - pcbTable.data();
+            p.state = NOT_ARRIVED;
+            p.core = -1;
+            p.level = 0;
+            p.vruntime = 0;
+            p.stateSince = 0;
+            pcb[NOT_ARRIVED].push_back(&p);
+        }
+        metricsCollector.reset(pcbTable, options.cpus);
+        //A streamed workload is read as it is needed instead
+        if (options.stream) {
+            workloadStream = std::make_unique<Parsing::WorkloadStream>(options.inputFile);
+        }
+    }
+
+    template <typename Policy>
+    SimulatorImpl<Policy>::SimulatorImpl(const Parsing::Options& options, Parsing::SnapshotReader& snapshot)
+        : options(options), outputDirectory(options.outputDir)
+    {
+        restored = true;
+        eventDriven = options.eventDriven;
+        Parsing::Options taken = Parsing::readSnapshotOptions(snapshot);
+        bool rekey = taken.strategy != options.strategy;
+
+        //A restore can fork the run into a new directory, which is made like the ones of batch and sweep mode
+        error_code error;
+        if (!outputDirectory.empty() && !filesystem::create_directories(outputDirectory, error) && error) {
+            cout << "Unable to create output directory " << outputDirectory << endl;
+            exit(1);
+        }
+
+        //Carry on writing the tables from where they were
+        Output::TracePosition trace;
+        trace.executionFileName = snapshot.getString();
+        trace.memoryStatusFileName = snapshot.getString();
+        trace.executionSize = snapshot.get<uint64_t>();
+        trace.memoryStatusSize = snapshot.get<uint64_t>();
+        if (options.traceFiles && !trace.executionFileName.empty()) {
+            traceOutput.resume(outputFilename("execution"), outputFilename("memory_status"), options.asyncTrace, trace);
+        }
+        string ganttFileName = snapshot.getString();
+        uint64_t ganttSize = snapshot.get<uint64_t>();
+        if (options.gantt && !ganttFileName.empty()) {
+            ganttOutput.resume(outputFilename("gantt", ".csv"), options.cpus > 1, ganttFileName, ganttSize);
+        }
+
+        timer = snapshot.get<int>();
+        memoryGeneration = snapshot.get<int>();
+        retryGeneration = snapshot.get<int>();
+        blockedReversed = snapshot.get<bool>();
+        blockedMinSize = snapshot.get<uint>();
+        nextTicket = snapshot.get<unsigned long>();
+        nextIoSequence = snapshot.get<unsigned long>();
+        int64_t arrival = snapshot.get<int64_t>();
+
+        //The processes, the table is never resized after this so the lists can point into it
+        pcbTable.resize(snapshot.get<uint64_t>());
+        vector<int64_t> partitionOf(pcbTable.size());
+        for (size_t i = 0; i < pcbTable.size(); i++) {
+            pcb_t& p = pcbTable[i];
+            p.slot = i;
+            p.pid = snapshot.get<uint>();
+            p.memorySize = snapshot.get<uint>();
+            p.arrivalTime = snapshot.get<uint>();
+            p.totalCPUTime = snapshot.get<uint>();
+            p.ioFrequency = snapshot.get<uint>();
+            p.ioDuration = snapshot.get<uint>();
+            p.ioCompletionTime = snapshot.get<uint>();
+            p.queueTicket = snapshot.get<unsigned long>();
+            p.core = snapshot.get<int>();
+            p.level = snapshot.get<uint>();
+            p.vruntime = snapshot.get<uint>();
+            p.stateSince = snapshot.get<int>();
+            p.state = snapshot.get<ProcessState>();
+            p.memoryAllocated = nullptr;
+            partitionOf[i] = snapshot.get<int64_t>();
+        }
+        for (int state = 0; state < NUM_STATES; state++) {
+            for (uint64_t index : snapshot.getVector<uint64_t>()) {
+                pcb[state].push_back(&pcbTable[index]);
+            }
+        }
+        nextArrival = (arrival < 0) ? nullptr : &pcbTable[arrival];
+        indexArrivals();
+
+        //The memory, the free partitions of a fixed layout follow from who owns each one
+        if (options.memoryMode == FIXED) {
+            memory = new Memory(options.partitionSizes);
+        } else {
+            memory = new Memory(options.memoryMode, 0);
+        }
+        memory->totalSize = snapshot.get<uint>();
+        memory->freeMemory = snapshot.get<uint>();
+        memory->usedMemory = snapshot.get<uint>();
+        memory->nextFitStart = snapshot.get<uint>();
+        memory->partitions = snapshot.getVector<Partition>();
+        if (memory->mode == FIXED) {
+            memory->freePartitions.clear();
+            for (size_t i = 0; i < memory->partitions.size(); i++) {
+                if (memory->partitions[i].code == -1) {
+                    memory->freePartitions.insert({memory->partitions[i].size, -(int) i});
                 }
             }
-            if (!isSpace) {
-                break; //leave the loop
+        }
+        for (const Partition& block : snapshot.getVector<Partition>()) {
+            memory->blocks[block.start] = block;
+        }
+        vector<uint> holes = snapshot.getVector<uint>();
+        for (size_t i = 0; i + 1 < holes.size(); i += 2) {
+            memory->holes.insert(holes[i], holes[i + 1]);
+        }
+        memory->buddyBlocks.resize(snapshot.get<uint64_t>());
+        for (set<uint>& blocks : memory->buddyBlocks) {
+            for (uint start : snapshot.getVector<uint>()) {
+                blocks.insert(start);
             }
-            //Next decide what processes to load into memory - this is where scheduling strategy comes into play
-            ExecutionOrder order = getExecutionOrder(pcb[NEW], true);
-            if (order.process == nullptr) {
-                break;
+        }
+        for (size_t i = 0; i < pcbTable.size(); i++) {
+            if (partitionOf[i] >= 0) {
+                pcbTable[i].memoryAllocated = (memory->mode == FIXED) ? &memory->partitions[partitionOf[i]] : &memory->blocks[partitionOf[i]];
             }
-            //Load that process into memory reservememory()
-            if (reserveMemory(memory, order.process->memorySize, order.process)) {
-                changeState(order.process, NEW, READY, pcb);
-                writeMemoryStatus(order.process->memorySize,pcb,memory);
-            } else {
-                //temporariily change the state to not ready
-                for (int i = 0; i < pcb[NEW].size(); i++) {
-                    if (pcb[NEW].at(i) == order.process) {
-                        pcb[NEW].erase((pcb[NEW].begin() + i));
-                        pcb[NOT_ARRIVED].push_front(order.process);
-                    }
-                }
+        }
+
+        //The queues, keeping the tickets so processes with equal keys stay in order
+        for (int state = 0; state < NUM_STATES; state++) {
+            restoreQueue(snapshot, schedulingQueues[state], (ProcessState) state, rekey);
+        }
+        for (const Event& event : snapshot.getVector<Event>()) {
+            if (eventDriven) {
+                eventQueue.push(event);
+            }
+        }
+        uint64_t ioCount = snapshot.get<uint64_t>();
+        for (uint64_t i = 0; i < ioCount; i++) {
+            IoCompletion completion;
+            completion.time = snapshot.get<int>();
+            completion.sequence = snapshot.get<unsigned long>();
+            completion.process = &pcbTable[snapshot.get<uint64_t>()];
+            ioWaits.push(completion, timer);
+        }
+        cores.resize(snapshot.get<uint64_t>());
+        for (Core& core : cores) {
+            int64_t running = snapshot.get<int64_t>();
+            core.running = (running < 0) ? nullptr : &pcbTable[running];
+            core.sliceEnd = snapshot.get<int>();
+            core.sliceStart = snapshot.get<int>();
+            core.nextState = snapshot.get<ProcessState>();
+            core.queued = snapshot.get<uint>();
+            restoreQueue(snapshot, core.readyQueue, READY, rekey);
+            //A snapshot taken while ticking has no events for the bursts in progress
+            if (core.running != nullptr && !taken.eventDriven) {
+                scheduleEvent(core.sliceEnd, (core.nextState == READY) ? QUANTUM_EXPIRY : BURST_END);
             }
         }
-    }
 
-    ExecutionOrder getExecutionOrder(deque<pcb_t*>& pcb, bool loadMem) {
-        switch (strategyUsed) {
-            case 0:
-                return schedulerFCFS(pcb);
-            case 1:
-                return schedulerEP(pcb, loadMem);
-            case 2:
-                return schedulerRR(pcb);
-            default:
-                return schedulerFCFS(pcb);
+        //The policy only carries over if it is the same one
+        vector<char> policyState = snapshot.getVector<char>();
+        if (!rekey && policyState.size() == sizeof(Policy)) {
+            memcpy((void*) &policy, policyState.data(), sizeof(Policy));
+        }
+        policy.configure(options);
+        metricsCollector.restore(snapshot);
+        while (nextCheckpoint < options.checkpoints.size() && options.checkpoints[nextCheckpoint] <= timer) {
+            nextCheckpoint++;
         }
     }
 
-    bool processesRemain(deque<pcb_t*>* pcb, Partition* memory) {
-        bool allNotTerminated = false;
-        for (int i = NOT_ARRIVED ; i < TERMINATED ; i++) {
-            if (!pcb[i].empty()) {
-                allNotTerminated = true;
-                break;
+    template <typename Policy>
+    void SimulatorImpl<Policy>::saveCheckpoint(string fileName)
+    {
+        Parsing::SnapshotWriter snapshot(fileName);
+        Parsing::Options taken = options;
+        taken.outputDir = outputDirectory;
+        Parsing::writeSnapshotOptions(snapshot, taken);
+
+        //The tables are written out so a restored simulation can keep everything up to here
+        Output::TracePosition trace = traceOutput.position();
+        snapshot.putString(trace.executionFileName);
+        snapshot.putString(trace.memoryStatusFileName);
+        snapshot.put(trace.executionSize);
+        snapshot.put(trace.memoryStatusSize);
+        uint64_t ganttSize = ganttOutput.position();
+        snapshot.putString(ganttOutput.isOpen() ? filesystem::absolute(ganttOutput.name()).string() : "");
+        snapshot.put(ganttSize);
+
+        snapshot.put(timer);
+        snapshot.put(memoryGeneration);
+        snapshot.put(retryGeneration);
+        snapshot.put(blockedReversed);
+        snapshot.put(blockedMinSize);
+        snapshot.put(nextTicket);
+        snapshot.put(nextIoSequence);
+        auto indexOf = [&](const pcb_t* p) { return (p == nullptr) ? (int64_t) -1 : (int64_t) (p - pcbTable.data()); };
+        snapshot.put(indexOf(nextArrival));
+
+        //The processes, a partition is identified by its number in a fixed layout and by its start address otherwise
+        snapshot.put<uint64_t>(pcbTable.size());
+        for (const pcb_t& p : pcbTable) {
+            snapshot.put(p.pid);
+            snapshot.put(p.memorySize);
+            snapshot.put(p.arrivalTime);
+            snapshot.put(p.totalCPUTime);
+            snapshot.put(p.ioFrequency);
+            snapshot.put(p.ioDuration);
+            snapshot.put(p.ioCompletionTime);
+            snapshot.put(p.queueTicket);
+            snapshot.put(p.core);
+            snapshot.put(p.level);
+            snapshot.put(p.vruntime);
+            snapshot.put(p.stateSince);
+            snapshot.put(p.state);
+            int64_t partition = -1;
+            if (p.memoryAllocated != nullptr) {
+                partition = (memory->mode == FIXED) ? p.memoryAllocated->partitionNum - 1 : p.memoryAllocated->start;
             }
+            snapshot.put(partition);
         }
-        bool memoryNotDeallocated = false;
-        for (int i = 0 ; i < MemoryStructures::PARTITION_NUM ; i++) {
-            if (memory[i].code != -1) {
-                memoryNotDeallocated = true;
-                break;
+        for (int state = 0; state < NUM_STATES; state++) {
+            vector<uint64_t> order;
+            order.reserve(pcb[state].size());
+            for (pcb_t* p : pcb[state]) {
+                order.push_back(indexOf(p));
             }
+            snapshot.putVector(order);
+        }
+
+        snapshot.put(memory->totalSize);
+        snapshot.put(memory->freeMemory);
+        snapshot.put(memory->usedMemory);
+        snapshot.put(memory->nextFitStart);
+        snapshot.putVector(memory->partitions);
+        vector<Partition> blocks;
+        blocks.reserve(memory->blocks.size());
+        for (auto& [start, block] : memory->blocks) {
+            blocks.push_back(block);
+        }
+        snapshot.putVector(blocks);
+        vector<uint> holes;
+        for (auto& [size, start] : memory->holes.bySize) {
+            holes.push_back(start);
+            holes.push_back(size);
+        }
+        snapshot.putVector(holes);
+        snapshot.put<uint64_t>(memory->buddyBlocks.size());
+        for (const set<uint>& free : memory->buddyBlocks) {
+            snapshot.putVector(vector<uint>(free.begin(), free.end()));
+        }
+
+        for (int state = 0; state < NUM_STATES; state++) {
+            saveQueue(snapshot, schedulingQueues[state]);
+        }
+        vector<Event> events;
+        for (auto pending = eventQueue; !pending.empty(); pending.pop()) {
+            events.push_back(pending.top());
+        }
+        snapshot.putVector(events);
+        snapshot.put<uint64_t>(ioWaits.size());
+        for (const IoCompletion& pending : ioWaits.pending()) {
+            snapshot.put(pending.time);
+            snapshot.put(pending.sequence);
+            snapshot.put<uint64_t>(indexOf(pending.process));
+        }
+        snapshot.put<uint64_t>(cores.size());
+        for (Core& core : cores) {
+            snapshot.put(indexOf(core.running));
+            snapshot.put(core.sliceEnd);
+            snapshot.put(core.sliceStart);
+            snapshot.put(core.nextState);
+            snapshot.put(core.queued);
+            saveQueue(snapshot, core.readyQueue);
+        }
+
+        snapshot.putVector(vector<char>((const char*) &policy, (const char*) &policy + sizeof(Policy)));
+        metricsCollector.save(snapshot);
+        snapshot.close();
+        if (verbose) {
+            cout << "Wrote a snapshot at time " << timer << " to " << fileName << '\n';
         }
-        return (allNotTerminated) || (memoryNotDeallocated); ;
     }
 
-    ExecutionOrder schedulerFCFS(deque<pcb_t*>& pcb) {
-        ExecutionOrder order;   
-        if (!pcb.empty()) {
-            //Use a bubble sort to sort all ready processes by lowest arrival time
-            //This way, processes with the same arrival time maintain their relative order
-            for (int i = 0; i < pcb.size() - 1; i++) {
-                for (int j = 0; j < pcb.size() - i - 1; j++) {
-                    if (pcb[j]->arrivalTime > pcb[j + 1]->arrivalTime) {
-                        pcb_t* temp = pcb[j];
-                        pcb[j] = pcb[j + 1];
-                        pcb[j + 1] = temp;
-                    }
-                }
+    template <typename Policy>
+    void SimulatorImpl<Policy>::saveQueue(Parsing::SnapshotWriter& snapshot, SchedulingQueue queue)
+    {
+        vector<QueueEntry> live;
+        for (; !queue.empty(); queue.pop()) {
+            if (queue.top().ticket == queue.top().process->queueTicket) {
+                live.push_back(queue.top());
             }
-            //Then get the foremost process
-            order.process = pcb.front();
-            order.time = pcb.front()->ioFrequency;
         }
-        return order;  
+        snapshot.put<uint64_t>(live.size());
+        for (const QueueEntry& entry : live) {
+            snapshot.put<uint64_t>(entry.process - pcbTable.data());
+            snapshot.put(entry.key);
+            snapshot.put(entry.ticket);
+        }
     }
 
-
-
-    ExecutionOrder schedulerEP(deque<pcb_t*>& pcb, bool loadMem) {
-        ExecutionOrder order;
-        if (!pcb.empty()) {
-            if (loadMem) {
-                return schedulerFCFS(pcb);
-            }
-            // Sort the pcb by ioFrequency from smallest to largest
-            for (int i = 0; i < pcb.size() - 1; i++) {
-                for (int j = 0; j < pcb.size() - i - 1; j++) {
-                    if (pcb[j]->pid > pcb[j + 1]->pid) {
-                        pcb_t* temp = pcb[j];
-                        pcb[j] = pcb[j + 1];
-                        pcb[j + 1] = temp;
-                    }
-                }
+    template <typename Policy>
+    void SimulatorImpl<Policy>::restoreQueue(Parsing::SnapshotReader& snapshot, SchedulingQueue& queue, ProcessState state, bool rekey)
+    {
+        uint64_t count = snapshot.get<uint64_t>();
+        for (uint64_t i = 0; i < count; i++) {
+            QueueEntry entry;
+            entry.process = &pcbTable[snapshot.get<uint64_t>()];
+            entry.key = snapshot.get<uint>();
+            entry.ticket = snapshot.get<unsigned long>();
+            if (rekey) {
+                entry.key = policy.key(entry.process, state);
             }
-            order.process = pcb.front();
-            order.time = pcb.front()->ioFrequency;
+            queue.push(entry);
         }
-        return order;
     }
 
-    ExecutionOrder schedulerRR(deque<pcb_t*>& pcb) {       
-        ExecutionOrder order;   
-        if (!pcb.empty()) {
-            order.process = pcb.front();
-            order.time = QUANTUM;
+    template <typename Policy>
+    string SimulatorImpl<Policy>::outputFilename(string prefix, string extension)
+    {
+        if (outputDirectory.empty()) {
+            return Parsing::getOutputFilename(prefix, options.inputFile, extension);
         }
-        return order;  
+        string name = filesystem::path(options.inputFile).filename().string();
+        return (filesystem::path(outputDirectory) / Parsing::getOutputFilename(prefix, name, extension)).string();
     }
 
-    void setOutputFiles(std::string executionFileName, std::string memoryStatusFileName)
+    template <typename Policy>
+    void SimulatorImpl<Policy>::writeMetrics()
     {
-        memoryStatusOutput.open(memoryStatusFileName);
-        if (memoryStatusOutput.fail())
-        {
-            cout << "Unable to open memory status output file." << std::endl;
-            exit(1);
+        if (options.metricsJson) {
+            metricsCollector.writeJson(outputFilename("metrics", ".json"), options.inputFile, options.strategy);
         }
-        executionOutput.open(executionFileName);
-        if (executionOutput.fail())
-        {
-            cout << "Unable to open execution output file." << std::endl;
-            exit(1);
+        if (options.metricsCsv) {
+            metricsCollector.writeCsv(outputFilename("metrics", ".csv"), outputFilename("metrics_processes", ".csv"), options.inputFile, options.strategy);
+            if (!cores.empty()) {
+                metricsCollector.writeCoreCsv(outputFilename("metrics_cores", ".csv"));
+            }
         }
     }
 
-    void writeExecutionStep(pcb_t* process, ProcessState currentState ,ProcessState nextState)
+    template <typename Policy>
+    void SimulatorImpl<Policy>::writeProfile()
     {
-        if (executionOutput.fail())
-        {
-            return;
+#ifdef SIM_PROFILE
+        //A simulation without tables, like a point of a sweep, has nowhere of its own to put a profile
+        if (options.traceFiles) {
+            profile.writeJson(outputFilename("profile", ".json"), options.inputFile, options.strategy);
         }
-        executionOutput << "| " << std::setw(18) << std::right << timer;
-        executionOutput << " | " << std::setw(2) << std::right << process->pid << " | " << std::setw(9) << std::right;
-        executionOutput<<  MemoryStructures::stateName(currentState) << " | " << std::setw(9) << std::right << MemoryStructures::stateName(nextState) << " |" << std::endl;
+#endif
     }
 
-    void writeMemoryStatus(int memAllocated, deque<pcb_t*>* pcb, MemoryStructures::Partition *memory)
+    template <typename Policy>
+    SimulatorImpl<Policy>::~SimulatorImpl()
     {
-        if (memoryStatusOutput.fail())
-        {
-            return;
+        delete memory;
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::run()
+    {
+        while (step()) {
         }
-        //Get the memory state, total free memory, and usable free memory
-        string memoryState = "";
-        int totalFreeMemory = 0;
-        int usableFreeMemory = 0;
-        for (int i = 0; i < PARTITION_NUM; i++)
-        {
-            if (memory[i].code == -1)
-            {
-                totalFreeMemory += memory[i].size;
-                usableFreeMemory += memory[i].size;
-            } else {
-                for (int z = READY ; z < TERMINATED ; z++) {
-                    for (int j = 0; j < pcb[z].size(); j++)
-                    {
-                        if (pcb[z].at(j)->pid == memory[i].code)
-                        {
-                            totalFreeMemory += memory[i].size - pcb[z].at(j)->memorySize;
-                            break;
-                        }
-                    }
+        finish();
+    }
+
+    template <typename Policy>
+    void SimulatorImpl<Policy>::start()
+    {
+        started = true;
+        profile.start();
+        PROFILE_QUEUE(NOT_ARRIVED, pcb[NOT_ARRIVED].size());
+        if (restored) {
+            if (verbose) {
+                cout << "Restored the simulation at time " << timer << '\n';
+            }
+        } else {
+            if (verbose && workloadStream) {
+                cout << "Streaming processes from " << options.inputFile << '\n';
+            } else if (verbose) {
+                cout << "Loaded PCB Table: " << '\n';
+                for (pcb_t* p : pcb[NOT_ARRIVED]) {
+                    cout << "PID: " << p->pid << " Memory Size: " << p->memorySize << " Arrival Time: " << p->arrivalTime << " Total CPU Time: " << p->totalCPUTime << " IO Frequency: " << p->ioFrequency << " IO Duration: " << p->ioDuration << '\n';
                 }
             }
-            memoryState +=  to_string(memory[i].code);
-            if (i != PARTITION_NUM - 1)
-            {
-                memoryState += ",";
+            if (workloadStream) {
+                streamProcess();
+            } else {
+                sortArrivals();
             }
+            //Print initial state of memory
+            writeMemoryStatus(0);
+            //Check for any processes arriving at t=0
+            checkArrived();
         }
-        //| Time of Event | Memory Used | Partitions State | Total Free Memory | Usable Free Memory |
-        memoryStatusOutput << "| " << std::setw(13) << std::right << timer;
-        memoryStatusOutput << " | " << std::setw(11) << std::right << memAllocated;
-        memoryStatusOutput << " | " << std::setw(16) << std::right << memoryState;
-        memoryStatusOutput << " | " << std::setw(17) << std::right << totalFreeMemory;
-        memoryStatusOutput << " | " << std::setw(18) << std::right << usableFreeMemory;
-        memoryStatusOutput << " | " << std::endl;
     }
 
-    void checkArrived(deque<pcb_t*>* pcb, Partition* memory) {
-        //Iterate through every single process not arrived process
-        for (int i = 0 ; i < pcb[NOT_ARRIVED].size() ; i++) {
-            //Check to see if it has not arrived and if the time is ready for arrival
-            if (pcb[NOT_ARRIVED].at(i)->arrivalTime <= Execution::timer) {
-                //change state without printing
-                pcb_t* temp = pcb[NOT_ARRIVED].at(i);
-                pcb[NEW].push_back(pcb[NOT_ARRIVED].at(i));
-                pcb[NOT_ARRIVED].erase(pcb[NOT_ARRIVED].begin() + i);
-                loadMemory(pcb, memory);
-                //Check if temp was moved back to NOT ARRIVED
-                for (int j = 0 ; j < pcb[NOT_ARRIVED].size() ; j++) {
-                    if (pcb[NOT_ARRIVED].at(j) == temp) {
-                        i++;
-                        break;
-                    }
-                }
-                i--;
+    template <typename Policy>
+    bool SimulatorImpl<Policy>::step()
+    {
+        if (!started) {
+            start();
+        }
+        //The execution and memory loading carry on until there are no procesess left
+        if (stopped || !processesRemain()) {
+            stopped = true;
+            return false;
+        }
+        //Snapshots are taken between execution cycles, at the first one at or after each time asked for
+        while (nextCheckpoint < options.checkpoints.size() && timer >= options.checkpoints[nextCheckpoint]) {
+            saveCheckpoint(outputFilename("checkpoint_" + to_string(options.checkpoints[nextCheckpoint]), ".bin"));
+            nextCheckpoint++;
+        }
+        if (!(cores.empty() ? doExecution() : doMultiCoreExecution())) { //handles the CPU
+            if (verbose) {
+                cout << "No further events can occur, stopping the simulation." << endl;
             }
+            stopped = true;
+            return false;
         }
+        return true;
     }
 
-    void doIO(deque<pcb_t*>* pcb) {
-        //Iterate through every single process in the waiting state
-        //Do the IO for any processes that are waiting during this time
-        //Increment waiting time for all proceses in the waiting state. Move to ready if their time has completed.
-        for (int i = 0 ; i < pcb[WAITING].size() ; i++) {
-            pcb[WAITING].at(i)->waitedTime++;
-            //Check to see if the process is ready to leave the waiting state
-            if (pcb[WAITING].at(i)->ioDuration <= pcb[WAITING].at(i)->waitedTime) {
-                pcb[WAITING].at(i)->waitedTime = 0;
-                changeState(pcb[WAITING].at(i), WAITING, READY, pcb);
-                i--;
+    template <typename Policy>
+    void SimulatorImpl<Policy>::finish()
+    {
+        if (finished) {
+            return;
+        }
+        finished = true;
+        if (!started) {
+            start();
+        }
+        //End the output files
+        writeFooters();
+        traceOutput.close();
+        if (options.index) {
+            string tableFile = outputFilename("execution");
+            Output::indexExecution(tableFile, Output::indexFilename(tableFile));
+        }
+        if (ganttOutput.isOpen()) {
+            string intervalFile = ganttOutput.name();
+            ganttOutput.close();
+            if (!options.ganttChart.empty()) {
+                Output::renderGantt(intervalFile, outputFilename("gantt", "." + options.ganttChart));
             }
         }
+        writeMetrics();
+        writeProfile();
     }
 
-    void doExecution(deque<pcb_t*>* pcb, Partition* memory)
-    {   
-        // We need to choose a process to run.
-        ExecutionOrder order = getExecutionOrder(pcb[READY], false);
+    template <typename Policy>
+    Simulator<Policy>::Simulator(const Parsing::Options& options, std::string outputDirectory)
+        : impl(std::make_unique<SimulatorImpl<Policy>>(options, outputDirectory))
+    {
+    }
 
-        //Check if there is a process to run
-        if (order.process != nullptr) {
-            //Determine the next state of the process
-            ProcessState nextState = READY;
-            if (order.time >= order.process->ioFrequency) {
-                nextState = WAITING;
-                order.time = order.process->ioFrequency;
-            }
-            if (((int) order.process->totalCPUTime - order.time) <= 0) {
-                nextState = TERMINATED;
-                order.time = order.process->totalCPUTime;
+    template <typename Policy>
+    Simulator<Policy>::Simulator(const Parsing::Options& options, std::vector<pcb_t> workload, std::string outputDirectory)
+        : impl(std::make_unique<SimulatorImpl<Policy>>(options, std::move(workload), outputDirectory))
+    {
+    }
+
+    template <typename Policy>
+    Simulator<Policy>::Simulator(const Parsing::Options& options, Parsing::SnapshotReader& snapshot)
+        : impl(std::make_unique<SimulatorImpl<Policy>>(options, snapshot))
+    {
+    }
+
+    //The simulation is only a complete type here, so this is where it can be destroyed
+    template <typename Policy>
+    Simulator<Policy>::~Simulator() = default;
+
+    template <typename Policy>
+    void Simulator<Policy>::run()
+    {
+        impl->run();
+    }
+
+    template <typename Policy>
+    bool Simulator<Policy>::step()
+    {
+        return impl->step();
+    }
+
+    template <typename Policy>
+    void Simulator<Policy>::finish()
+    {
+        impl->finish();
+    }
+
+    template <typename Policy>
+    void Simulator<Policy>::onTransition(TransitionCallback callback)
+    {
+        impl->onTransition(std::move(callback));
+    }
+
+    template <typename Policy>
+    int Simulator<Policy>::time() const
+    {
+        return impl->time();
+    }
+
+    template <typename Policy>
+    const Metrics::Collector& Simulator<Policy>::metrics() const
+    {
+        return impl->metrics();
+    }
+
+    template <typename Policy>
+    void Simulator<Policy>::setVerbose(bool verbose)
+    {
+        impl->verbose = verbose;
+    }
+
+    //Every policy is built here, so a program linking the library only needs the header
+    template class Simulator<Policies::FCFS>;
+    template class Simulator<Policies::EP>;
+    template class Simulator<Policies::RR>;
+    template class Simulator<Policies::SJF>;
+    template class Simulator<Policies::SRTF>;
+    template class Simulator<Policies::MLFQ>;
+    template class Simulator<Policies::CFS>;
+
+    /**
+     * This function runs a number of independent jobs on a pool of threads. The workers take the next job until
+     * there are none left.
+     * @param count - the number of jobs
+     * @param threads - the number of threads, 0 for one per core
+     * @param job - runs the job with the given index
+    */
+    template <typename Job>
+    static void runJobs(size_t count, uint threads, Job job)
+    {
+        atomic<size_t> nextJob{0};
+        auto worker = [&]() {
+            for (size_t index = nextJob++; index < count; index = nextJob++) {
+                job(index);
             }
-            changeState(order.process, READY, RUNNING, pcb);
-            //Increment the timer while checking for any processes that have arrived or finished IO
-            for (int i = 0 ; i < order.time ; i++) {
-                timer += 1;
-                order.process->totalCPUTime -= 1;
-                checkArrived(pcb,memory);
-                doIO(pcb);
+        };
+        unsigned threadCount = threads;
+        if (threadCount == 0) {
+            threadCount = max(1u, thread::hardware_concurrency());
+        }
+        threadCount = min<size_t>(threadCount, max<size_t>(count, 1));
+        vector<thread> pool;
+        for (unsigned i = 0; i < threadCount; i++) {
+            pool.emplace_back(worker);
+        }
+        for (thread& t : pool) {
+            t.join();
+        }
+    }
+
+    void runBatch(const Parsing::Options& options)
+    {
+        //Every input file in the directory is run with every strategy
+        vector<filesystem::path> inputs;
+        error_code error;
+        for (const filesystem::directory_entry& entry : filesystem::directory_iterator(options.inputFile, error)) {
+            if (entry.is_regular_file()) {
+                inputs.push_back(entry.path());
             }
-            changeState(order.process, RUNNING, nextState, pcb);
-            if (nextState == TERMINATED) {
-                order.process->memoryAllocated->code = -1;
-                order.process->memoryAllocated = nullptr;
-                writeMemoryStatus(order.process->memorySize,pcb,memory);
-                loadMemory(pcb, memory);
+        }
+        if (error) {
+            cout << "Unable to read input directory " << options.inputFile << endl;
+            exit(1);
+        }
+        sort(inputs.begin(), inputs.end());
+        vector<pair<filesystem::path, size_t>> jobs; //each input with the index of a strategy
+        for (const filesystem::path& input : inputs) {
+            for (size_t s = 0; s < options.strategies.size(); s++) {
+                jobs.push_back({input, s});
             }
-        } else {
-            timer += 1;
-            checkArrived(pcb,memory);
-            doIO(pcb);
         }
+
+        mutex resultLock;
+        vector<Metrics::LatencyHistograms> latencies(options.strategies.size()); //every run of a strategy merged together
+        runJobs(jobs.size(), options.jobs, [&](size_t job) {
+            const filesystem::path& input = jobs[job].first;
+            const string& strategy = options.strategies[jobs[job].second];
+            filesystem::path directory = filesystem::path(options.outputDir) / input.stem() / strategy;
+            filesystem::create_directories(directory);
+            Parsing::Options jobOptions = options;
+            jobOptions.inputFile = input.string();
+            jobOptions.strategy = strategy;
+            withPolicy(strategy, [&](auto policy) {
+                Simulator<typename decltype(policy)::type> simulator(jobOptions, directory.string());
+                simulator.setVerbose(false);
+                simulator.run();
+                lock_guard<mutex> lock(resultLock);
+                latencies[jobs[job].second].merge(simulator.metrics().histograms());
+            });
+            cout << "Finished " << input.filename().string() << " " << strategy << endl;
+        });
+        filesystem::create_directories(options.outputDir);
+        Metrics::writePercentiles((filesystem::path(options.outputDir) / "percentiles.csv").string(), options.strategies, latencies);
+        cout << "Completed " << jobs.size() << " simulations." << endl;
     }
 
-    bool changeState(pcb_t* process, ProcessState initialState, ProcessState finalState, deque<pcb_t*>* pcb) {
-        //Get the process
-        for (int i = 0; i < pcb[initialState].size(); i++) {
-            if (pcb[initialState].at(i) == process) {
-                pcb[initialState].erase((pcb[initialState].begin() + i));
-                pcb[finalState].push_back(process);
-                writeExecutionStep(process, initialState, finalState);
-                return true;
+    void runSweep(const Parsing::Options& options)
+    {
+        //Parse the input once, every run gets its own copy of the table
+        const vector<pcb_t> workload = Parsing::loadPCBTable(options.inputFile);
+        vector<uint> quanta = options.quanta;
+        if (quanta.empty()) {
+            quanta.push_back((options.quantum != 0) ? options.quantum : QUANTUM);
+        }
+        vector<vector<uint>> layouts = options.layouts;
+        if (layouts.empty()) {
+            layouts.push_back(options.partitionSizes);
+        }
+        //A process that never fits would leave its simulation running forever, so check every layout up front
+        uint largestProcess = 0;
+        for (const pcb_t& p : workload) {
+            largestProcess = max(largestProcess, p.memorySize);
+        }
+        for (const vector<uint>& layout : layouts) {
+            //The address space is the memory size when it is given, like in the simulator
+            uint total = (options.memorySize != 0) ? options.memorySize : accumulate(layout.begin(), layout.end(), 0u);
+            Memory empty = (options.memoryMode == FIXED) ? Memory(layout) : Memory(options.memoryMode, total);
+            if (!empty.fits(largestProcess)) {
+                cout << "A partition layout is too small for a process of size " << largestProcess << "." << endl;
+                exit(1);
             }
         }
-        return false;
-    }
 
-    void setStrategyUsed(std::string strategy) {
-        if (strategy == "FCFS") {
-            strategyUsed = 0;
-        } else if (strategy == "EP") {
-            strategyUsed = 1;
-        } else if (strategy == "RR") {
-            strategyUsed = 2;
+        //Only the metrics of each point are kept, so the tables and metrics files are not written
+        Parsing::Options shared = options;
+        shared.traceFiles = false;
+        shared.metricsJson = false;
+        shared.metricsCsv = false;
+        size_t points = options.strategies.size() * quanta.size() * layouts.size();
+        vector<string> rows(points);
+        runJobs(points, options.jobs, [&](size_t point) {
+            Parsing::Options pointOptions = shared;
+            pointOptions.strategy = options.strategies[point / (quanta.size() * layouts.size())];
+            pointOptions.quantum = quanta[point / layouts.size() % quanta.size()];
+            pointOptions.partitionSizes = layouts[point % layouts.size()];
+            withPolicy(pointOptions.strategy, [&](auto policy) {
+                Simulator<typename decltype(policy)::type> simulator(pointOptions, workload);
+                simulator.setVerbose(false);
+                simulator.run();
+                stringstream row;
+                row << pointOptions.strategy << "," << pointOptions.quantum << ",";
+                for (size_t i = 0; i < pointOptions.partitionSizes.size(); i++) {
+                    row << ((i == 0) ? "" : " ") << pointOptions.partitionSizes[i];
+                }
+                simulator.metrics().writeSummaryRow(row);
+                rows[point] = row.str();
+            });
+        });
+
+        filesystem::create_directories(options.outputDir);
+        string fileName = (filesystem::path(options.outputDir) / "sweep.csv").string();
+        ofstream output(fileName);
+        if (output.fail()) {
+            cout << "Unable to open sweep output file." << endl;
+            exit(1);
         }
+        output << "strategy,quantum,partitions";
+        Metrics::Collector::writeSummaryHeader(output);
+        output << "\n";
+        for (const string& row : rows) {
+            output << row << "\n";
+        }
+        cout << "Completed " << points << " simulations, results in " << fileName << "." << endl;
     }
 }
 
-
+//Left out of the library, which harnesses and the benchmark link with their own main
+#ifndef SIM_NO_MAIN
 int main(int argc, char *argv[])
 {
-    // Check to make sure there are arguments
-    if (argc != Parsing::ARGUMENT_NUM)
-    {
-        cout << "There must be " << Parsing::ARGUMENT_NUM << " argument." << endl;
-        return 1;
-    }
-    //Set the output
-    Execution::setOutputFiles(Parsing::getOutputFilename("execution",argv[1]),Parsing::getOutputFilename("memory_status",argv[1]));
-    Execution::setStrategyUsed(argv[2]);
-    //Print the headers of both files
-    //Execution output header
-    Execution::executionOutput << "+------------------------------------------------+" << std::endl;
-    Execution::executionOutput << "|Time of Transition |PID | Old State | New State |" << std::endl;
-    Execution::executionOutput << "+------------------------------------------------+" << std::endl;
-    //Memory Status output header
-    Execution::memoryStatusOutput << "+------------------------------------------------------------------------------------------+" << std::endl; 
-    Execution::memoryStatusOutput << "| Time of Event | Memory Used | Partitions State | Total Free Memory | Usable Free Memory |" << std::endl;
-    Execution::memoryStatusOutput << "+------------------------------------------------------------------------------------------+" << std::endl;
-
-    // Initialize memory partitions with the proper sizes.
-    using namespace MemoryStructures;
-    
-    cout << "Initializing memory partitions" << endl;
-    Partition *memory = new Partition[PARTITION_NUM];
-    if (memory == nullptr) {
-        cout << "Failed to allocate memory" << endl;
-        return 1;
+    Parsing::Options options = Parsing::parseArguments(argc, argv);
+    if (options.convert) {
+        Parsing::convertWorkload(options.inputFile, options.outputFile);
+        return 0;
     }
-    for (int i = 0; i < PARTITION_NUM; i++)
-    {
-        memory[i] = (Partition){.partitionNum = __uint8_t(i + 1), .size = __uint8_t(PARTITION_SIZES[i]), .code = -1};
+    if (options.renderGantt) {
+        Output::renderGantt(options.inputFile, options.outputFile);
+        return 0;
     }
-
-    // Create the PCB table
-    deque<pcb_t*> pcb[Execution::NUM_STATES];
-    pcb[0] = Parsing::loadPCBTable(argv[1]);  // Initialize pcb entry
-    cout << "Loaded PCB Table: " << endl;
-    for (pcb_t* p : pcb[0]) {
-        cout << "PID: " << p->pid << " Memory Size: " << p->memorySize << " Arrival Time: " << p->arrivalTime << " Total CPU Time: " << p->totalCPUTime << " IO Frequency: " << p->ioFrequency << " IO Duration: " << p->ioDuration << endl;
+    if (options.buildIndex) {
+        Output::indexExecution(options.inputFile, Output::indexFilename(options.inputFile));
+        return 0;
     }
-    //Print initial state of memory
-    Execution::writeMemoryStatus(0,pcb,memory);
-    //Check for any processes arriving at t=0
-    Execution::checkArrived(pcb,memory);
-    //Now begin the execution and memory loading until there are no procesess left
-    while (Execution::processesRemain(pcb,memory))
-    {
-       Execution::doExecution(pcb,memory); //handles the CPU
+    if (!options.query.empty()) {
+        Output::queryExecution(options.inputFile, options.query);
+        return 0;
     }
-
-    //End the output files
-    Execution::memoryStatusOutput << "+------------------------------------------------------------------------------------------+" << std::endl;
-    Execution::executionOutput << "+------------------------------------------------+" << std::endl;
-    //Close files
-    Execution::executionOutput.close();
-    Execution::memoryStatusOutput.close();
-    // Cleanup
-    delete[] memory;
-    for (int i = 0 ; i < Execution::NUM_STATES ; i++) {
-        for (int j = 0 ; j < pcb[i].size() ; j++) {
-            delete pcb[i].at(j);
-        }
+    if (options.batch) {
+        Execution::runBatch(options);
+        return 0;
+    }
+    if (options.sweep) {
+        Execution::runSweep(options);
+        return 0;
     }
+    if (options.restore) {
+        Parsing::SnapshotReader snapshot(options.snapshotFile);
+        Execution::withPolicy(options.strategy, [&](auto policy) {
+            Execution::Simulator<typename decltype(policy)::type> simulator(options, snapshot);
+            simulator.run();
+        });
+        cout << "Completed execution." << endl;
+        return 0;
+    }
+    cout << "Initializing memory partitions" << endl;
+    Execution::withPolicy(options.strategy, [&](auto policy) {
+        Execution::Simulator<typename decltype(policy)::type> simulator(options);
+        simulator.run();
+    });
     cout << "Completed execution." << endl;
-    // All other structs are deallocated when vector activates their deconstructors.
     return 0;
 }
+#endif
@@ -1,5 +1,7 @@
 /**
- * This file contains code for the interrupt simulator
+ * This file contains the interface of the interrupt simulator, which is all a program embedding it needs.
+ * Everything else the simulator is made of is in interrupts_internal.hpp, which only the simulator itself includes,
+ * so changing it does not change this interface.
  * @date September 30th, 2024
  * @author John Khalife, Stavros Karamalis
 */
@@ -8,23 +10,27 @@
 #define __INTERRUPTS_H__
 
 //dependencies
-#include <iostream>
-#include <fstream>
 #include <string>
-#include <unordered_map>
-#include <deque>
+#include <string_view>
+#include <functional>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <sys/types.h>
 
-//This holds all of the memory structures used in this program
+//This holds the memory structures a program embedding the simulator sees
 namespace MemoryStructures {
-    const int PARTITION_SIZES[] = {40,25,15,10,8,2};
-    const int PARTITION_NUM = 6; 
+    struct Partition; //a piece of memory held by a process, defined with the rest of the simulator
+    typedef Partition part_t;
 
-    //This structure represents a single partition
-    struct Partition {
-        uint partitionNum;
-        uint size;
-        int code; //holds the PID
-    } typedef part_t;
+    //These are the ways memory can be handed out
+    enum MemoryMode {
+        FIXED, //best fit over a fixed partition layout
+        FIRST_FIT, //dynamic partitioning, the lowest address that fits
+        NEXT_FIT, //dynamic partitioning, first fit starting from the end of the last allocation
+        BEST_FIT, //dynamic partitioning, the smallest hole that fits
+        BUDDY //dynamic partitioning in power of two blocks
+    };
 
     //These hold the current process state
     enum ProcessState {
@@ -37,6 +43,7 @@ namespace MemoryStructures {
     };
 
     //This structure represents a single PCB entry.
+    //Every entry is linked into the list of the state it is currently in.
     struct PcbEntry {
         uint pid;
         uint memorySize;
@@ -45,186 +52,264 @@ namespace MemoryStructures {
         uint ioFrequency;
         uint ioDuration;
         part_t* memoryAllocated;
-        uint waitedTime;
+        uint ioCompletionTime; //the time the current IO finishes at
+        unsigned long queueTicket; //identifies the current entry in a scheduling queue, 0 if there is none
+        int core; //the CPU the process last ran on or is queued for, -1 before it is first queued
+        uint level; //the feedback queue the process is in, only used by MLFQ
+        uint vruntime; //the CPU time the process has been charged, only used by CFS
+        uint slot; //the position of the process in the pcb table, which is also its row in the metrics
+        int stateSince; //when the process entered its state, which starts its Gantt interval
+        ProcessState state; //the state list the entry is linked into
+        PcbEntry* prev; //the previous entry in the state list
+        PcbEntry* next; //the next entry in the state list
     } typedef pcb_t;
 
-    //This structure represents an execution order
-    //It is responsible for stating what process should be executed and for how long
-    struct ExecutionOrder {
-        pcb_t* process;
-        int time;
-        ExecutionOrder() : process(nullptr), time(0) {}
-    };
+    //The names the states are written with, in the order of ProcessState
+    inline constexpr std::string_view STATE_NAMES[] = {"NOT_ARRIVED", "NEW", "READY", "RUNNING", "WAITING", "TERMINATED"};
 
-    std::string stateName(ProcessState state) {
-        switch (state) {
-            case NEW:
-                return "NEW";
-            case READY:
-                return "READY";
-            case WAITING:
-                return "WAITING";
-            case RUNNING:
-                return "RUNNING";
-            case TERMINATED:
-                return "TERMINATED";
-            case NOT_ARRIVED:
-                return "NOT_ARRIVED";
-            default:
-                return "UNKNOWN";
-        }
+    /**
+     * This function returns the name a state is written with. The name is never copied, so logging allocates nothing.
+     * @param state - the state
+     * @return the name of the state
+    */
+    constexpr std::string_view stateName(ProcessState state) {
+        return (state >= NOT_ARRIVED && state <= TERMINATED) ? STATE_NAMES[state] : "UNKNOWN";
     }
 }
 
 //These functions and structures are responsible for getting input for the program and parsing it.
 namespace Parsing {
-    const int ARGUMENT_NUM = 3; // The number of arguments allowed in the program + 1
+    //This structure holds everything that was given on the command line
+    struct Options {
+        std::string inputFile;
+        std::string strategy;
+        bool convert = false; //Convert the input file between text and binary instead of simulating
+        std::string outputFile; //Where the converted workload goes
+        bool eventDriven = false; //Jump the clock between events instead of ticking
+        bool asyncTrace = false; //Format and write the output tables on a background thread
+        bool traceFiles = true; //Write the execution and memory status tables at all
+        bool metricsJson = false; //Write the scheduling metrics as JSON
+        bool metricsCsv = false; //Write the scheduling metrics as CSV
+        uint cpus = 1; //The number of simulated CPUs
+        uint quantum = 0; //The round robin quantum, 0 for the default
+        std::vector<uint> partitionSizes; //The memory partition layout
+        MemoryStructures::MemoryMode memoryMode = MemoryStructures::FIXED; //How memory is handed out
+        uint memorySize = 0; //The size of the address space when partitioning dynamically, 0 to use the sum of the partition sizes
+        bool batch = false; //Run every file in the input directory instead of a single input file
+        std::vector<std::string> strategies; //The strategies each input is run with in batch mode
+        uint jobs = 0; //The number of simulations run at once in batch mode, 0 for one per core
+        std::string outputDir = "batch_output"; //Where batch and sweep mode write their results
+        bool sweep = false; //Run the input file over a grid of quanta, partition layouts and strategies
+        std::vector<uint> quanta; //The round robin quanta a sweep tries
+        std::vector<std::vector<uint>> layouts; //The partition layouts a sweep tries
+        std::vector<int> checkpoints; //The times a snapshot of the simulation is written at
+        bool restore = false; //Carry on from a snapshot instead of starting from the input file
+        std::string snapshotFile; //The snapshot a restored simulation carries on from
+        bool stream = false; //Read the processes one at a time as they arrive instead of loading them all first
+        bool gantt = false; //Write every run and IO interval of every process
+        std::string ganttChart; //svg or html to draw the intervals as a Gantt chart at the end, empty for none
+        bool renderGantt = false; //Draw a Gantt chart from an intervals file instead of simulating
+        bool index = false; //Write an index of the execution table, so it can be queried without reading all of it
+        bool buildIndex = false; //Index an execution table that has already been written instead of simulating
+        std::string query; //--at=, --range= or --pid= to answer from an indexed execution table instead of simulating
+    };
+
+    class SnapshotReader; //what a simulation is restored from, defined with the rest of the simulator
 
     /**
-     * This function reads from a given input data text file and returns a pcb table.
+     * This function reads the command line into an options structure. The input file and strategy
+     * come first, followed by any optional flags. Exits the program if the arguments are invalid.
+     * Alternatively --convert followed by an input and output file converts a workload, --batch followed
+     * by a directory runs every file in it and --sweep followed by an input file runs it over a grid of settings.
+     * --restore followed by a snapshot carries on from it, with the options it was taken with unless flags change them.
+     * @param argc - the number of arguments
+     * @param argv - the arguments themselves
+     * @return the parsed options
+    */
+    Options parseArguments(int argc, char *argv[]);
+
+    /**
+     * This function reads from a given input data file and returns a pcb table.
+     * The file is memory mapped and read straight into one contiguous table. Binary workloads are recognized
+     * by their header, anything else is read as text.
      * @param fileName - a fileName to read the input from
-     * @return a pcbEntry vector containing the entire pcb.
+     * @return a pcbEntry vector containing the entire pcb. It is never resized so entries can be pointed to.
     */
-    std::deque<MemoryStructures::PcbEntry*> loadPCBTable(std::string fileName);
+    std::vector<MemoryStructures::PcbEntry> loadPCBTable(std::string fileName);
 
     /**
-     * This method takes the filename of the input file given, and grabs all student ids. it does this so that
-     * the output files can have the same ids and can be correlated with each other.
-     * @param fileName - the filename that was passed to the script before running
-     * @return A list of student numbers to be put into the output files.
+     * This function writes a pcb table as a binary workload
+     * @param pcbTable - the processes to write
+     * @param fileName - the file to write to
     */
-    std::deque<std::string> grabStudentNumbers(std::string fileName);
+    void writeBinaryWorkload(const std::vector<MemoryStructures::PcbEntry>& pcbTable, std::string fileName);
 
     /**
-     * This method takes a filename and returns the name of an output file
-     * @param prefix - the prefix to add before the student names
-     * @param fileName - the name of the input file
-     * @return a string containing the name of the execution file
+     * This function writes a pcb table as a text workload, in the same format generateInput.py uses
+     * @param pcbTable - the processes to write
+     * @param fileName - the file to write to
     */
-    std::string getOutputFilename(std::string prefix, std::string fileName);
+    void writeTextWorkload(const std::vector<MemoryStructures::PcbEntry>& pcbTable, std::string fileName);
 };
 
+//The scheduling metrics a simulation keeps, which are defined with the rest of the simulator
+namespace Metrics {
+    class Collector;
+}
+
 //All functions in this namespace are responsible for execution
 namespace Execution {
-    int timer = 0; //Necessary for keeping track of the program time over multiple functions within execution
-    std::ofstream executionOutput; //output object for the main output file
-    std::ofstream memoryStatusOutput; //output object for the memoryStatus.
-    int strategyUsed = 0; //The strategy used for the scheduler
-    const int QUANTUM = 100; //The time quantum for the round robin scheduler
-    const int NUM_STATES = 6; //The number of states in the program
-
     using namespace MemoryStructures;
 
-    /**
-     * This function reserves the memory. by best fit
-     * @param memory - pointer to the memory object
-     * @param partitionNum - parition number
-     * @param programName - what the partition is reserved for.
-     * @return - a boolean stating whether or not the memory was reserved.
-     * @
-    */
-    bool reserveMemory(Partition *memory, uint size, pcb_t* process);
+    //The scheduling policies, which are defined with the rest of the simulator
+    namespace Policies {
+        struct FCFS;
+        struct EP;
+        struct RR;
+        struct SJF;
+        struct SRTF;
+        struct MLFQ;
+        struct CFS;
+    }
 
-    /**
-     * This function evaluates the memory and decides what processes to load into main memory. 
-     * It also is responsible for changing state from NOT_ARRIVED to NEW and NEW to ready.
-     * @param pcb - the pcb table
-     * @param memory - the memory array
-    */
-    void loadMemory(std::deque<pcb_t*>* pcb, Partition* memory);
+    //This names a policy without needing its definition, withPolicy hands one to its visitor
+    template <typename Policy>
+    struct PolicyTag {
+        using type = Policy;
+    };
 
-    /**
-     * This function is responsible for returning an execution order. It states what process should run and for how long.
-     * @param pcb - the pcb table containing all processes
-     * @loadMem - a boolean stating whether or not to load memory
-     * @return an execution order.
-    */
-    ExecutionOrder getExecutionOrder(std::deque<pcb_t*>& pcb, bool loadMem);
+    //The simulation behind Simulator, defined with the rest of the simulator
+    template <typename Policy>
+    class SimulatorImpl;
 
-    /**
-     * This function is responsible for returning true if there are still processes to run.
-     * @param pcb - the pcb table
-     * @param memory - the memory array
-     * @return true if there are processes to run, false otherwise.
-     */
-    bool processesRemain(std::deque<pcb_t*>* pcb, Partition* memory);
+    //This class is a single simulation. It owns everything the simulation touches, its pcb table, memory, clock
+    //and output files, so any number of them can run at the same time on different threads.
+    //The scheduling policy is fixed when the class is instantiated, use withPolicy to pick it by name.
+    //Everything the simulation holds is kept behind a pointer, so it can change without changing this class.
+    template <typename Policy>
+    class Simulator {
+    public:
+        //This is called with the process, the state it left, the state it entered and the time for every line of the
+        //execution table. The process is only valid during the call.
+        using TransitionCallback = std::function<void(const pcb_t& process, ProcessState from, ProcessState to, int time)>;
 
-    /**
-     * This function is responsible for executing the first come first serve
-     * scheduling algorithm
-     * @param pcb - the pcb table
-    */
-    ExecutionOrder schedulerFCFS(std::deque<pcb_t*>& pcb);
+        /**
+         * This constructor sets up a simulation: it opens the output files, creates the memory and loads the pcb table.
+         * The output files are named after the input file.
+         * @param options - the input file, strategy and everything else given on the command line
+         * @param outputDirectory - the directory the output files go in, empty for the current directory
+        */
+        Simulator(const Parsing::Options& options, std::string outputDirectory = "");
 
-    /**
-     * This function is responsible for executing the external priority scheduling algorithm
-     * @param pcb - the pcb table
-     * @param loadMem - a boolean stating whether or not to load memory
-    */
-    ExecutionOrder schedulerEP(std::deque<pcb_t*>& pcb, bool loadMem);
+        /**
+         * This constructor sets up a simulation of a workload that has already been loaded, so that many simulations
+         * can share a single parse of the input file.
+         * @param options - the strategy and everything else given on the command line, the input file only names the output
+         * @param workload - the pcb table to simulate, moved from when it is not needed again and copied otherwise
+         * @param outputDirectory - the directory the output files go in, empty for the current directory
+        */
+        Simulator(const Parsing::Options& options, std::vector<pcb_t> workload, std::string outputDirectory = "");
 
-    /**
-     * This function is responsible for executing the round robin scheduling algorithm
-     * @param pcb - the pcb table
-    */
-    ExecutionOrder schedulerRR(std::deque<pcb_t*>& pcb);
+        /**
+         * This constructor carries on a simulation from a snapshot, without replaying anything before it. The tables
+         * keep what was written before the snapshot and the rest is added after it. The options must be the ones the
+         * snapshot was taken with apart from the strategy, quantum, engine, outputs and checkpoints.
+         * @param options - the options, with the output directory set to where the output files go
+         * @param snapshot - the snapshot, nothing has been read from it yet
+        */
+        Simulator(const Parsing::Options& options, Parsing::SnapshotReader& snapshot);
+        ~Simulator();
+        Simulator(const Simulator&) = delete;
+        Simulator& operator=(const Simulator&) = delete;
 
-    /**
-     * This method sets the output file for execution
-     * @param executionFileName - the name of the primary output file
-     * @param memoryStatusFileName - the name of the secondary output file
-    */
-    void setOutputFiles(std::string executionFileName, std::string memoryStatusFileName);
+        /**
+         * This method runs the simulation until every process has terminated, then closes the output files.
+        */
+        void run();
 
-    /**
-     * This method sets the strategy used for the scheduler 
-     * @param strategy - the strategy used
-    */
-    void setStrategyUsed(std::string strategy);
+        /**
+         * This method runs one cycle of the simulation, which is one burst on a single CPU or one tick of every CPU.
+         * The first call loads the processes that arrive at time 0 first.
+         * @return false once every process has terminated or nothing further can happen, true otherwise
+        */
+        bool step();
 
-    /**
-     * This method writes the memory status to the output file
-     * @param memAllocated - the memory allocated
-     * @param pcb - the pcb table
-    */
-    void writeMemoryStatus(int memAllocated, std::deque<pcb_t*>* pcb, MemoryStructures::Partition *memory);
+        /**
+         * This method ends the output files and writes the metrics. A simulation driven by step has to call it once
+         * step returns false, run does it itself.
+        */
+        void finish();
 
-    /**
-     * This method writes the execution step to the output file
-     * @param process - the process to execute
-     * @param currentState - the current state of the process
-     * @param nextState - the next state of the process
-    */
-    void writeExecutionStep(pcb_t* process, ProcessState currentState ,ProcessState nextState);
+        /**
+         * This method adds a function to be called on every state transition, in the order they are added
+         * @param callback - the function
+        */
+        void onTransition(TransitionCallback callback);
 
-    /**
-     * This method is intended to do one execution cycle of a process.
-     * @param pcb - the pcb table
-    */
-    void doExecution(std::deque<pcb_t*>* pcb, MemoryStructures::Partition* memory);
+        /**
+         * This method returns the simulated time
+         * @return the time reached so far
+        */
+        int time() const;
+
+        /**
+         * This method returns the scheduling metrics, which are kept up to date as the simulation runs.
+         * The collector is only declared here, reading it takes the internal header.
+         * @return the metrics collector
+        */
+        const Metrics::Collector& metrics() const;
+
+        /**
+         * This method turns the progress printed to the console on or off, it is on to begin with
+         * @param verbose - whether progress is printed
+        */
+        void setVerbose(bool verbose);
+
+    private:
+        std::unique_ptr<SimulatorImpl<Policy>> impl; //the simulation itself
+    };
 
     /**
-     * This function is responsible for changing the state of a process
-     * @param process - the process to change the state of
-     * @param initialIndex - the initial index representing the initial state
-     * @param finalIndex - the final index representing the final state
-     * @return true if the state was changed, false otherwise.
+     * This function calls a visitor with the policy of a strategy, so a simulator can be instantiated for it.
+     * Unknown strategies fall back to FCFS. Only the strategy given as the second argument can be unknown, the flags
+     * that name strategies reject anything else.
+     * @param strategy - FCFS, EP, RR, SJF, SRTF, MLFQ or CFS
+     * @param visit - called with a PolicyTag of the policy
     */
-    bool changeState(pcb_t* process, ProcessState initialState, ProcessState finalState, std::deque<MemoryStructures::PcbEntry *>* pcb);
+    template <typename Visitor>
+    void withPolicy(const std::string& strategy, Visitor visit)
+    {
+        if (strategy == "EP") {
+            visit(PolicyTag<Policies::EP>());
+        } else if (strategy == "RR") {
+            visit(PolicyTag<Policies::RR>());
+        } else if (strategy == "SJF") {
+            visit(PolicyTag<Policies::SJF>());
+        } else if (strategy == "SRTF") {
+            visit(PolicyTag<Policies::SRTF>());
+        } else if (strategy == "MLFQ") {
+            visit(PolicyTag<Policies::MLFQ>());
+        } else if (strategy == "CFS") {
+            visit(PolicyTag<Policies::CFS>());
+        } else {
+            visit(PolicyTag<Policies::FCFS>());
+        }
+    }
 
     /**
-     * This function is responsible for doing checking if any processes have arrived
-     * if they have, move them to new state
-     * @param pcb - the pcb table
-     * @param memory - the memory array
+     * This function runs every input file in a directory with every strategy asked for, spread over a pool of threads.
+     * The output of each run goes to its own directory, <output directory>/<input name>/<strategy>.
+     * The latency percentiles of each strategy over every input go to <output directory>/percentiles.csv.
+     * @param options - the directory, strategies, thread count and the options every simulation shares
     */
-    void checkArrived(std::deque<pcb_t*>* pcb, Partition* memory);
+    void runBatch(const Parsing::Options& options);
 
     /**
-     * This function is responsible for checking if a process is done waiting
-     * if so, it changes to ready state
-     * @param pcb - the pcb table
+     * This function runs a single input file with every combination of round robin quantum, partition layout and
+     * strategy asked for, spread over a pool of threads. The input is parsed once and shared by every run.
+     * Only metrics are kept, one row per combination in <output directory>/sweep.csv.
+     * @param options - the input file, the grid, the thread count and the options every simulation shares
     */
-    void doIO(std::deque<pcb_t*>* pcb);
+    void runSweep(const Parsing::Options& options);
 };
-#endif
\ No newline at end of file
+#endif
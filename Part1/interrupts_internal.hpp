@@ -0,0 +1,1729 @@
+/**
+ * This file contains the internals of the interrupt simulator. Only the simulator itself includes it, programs
+ * embedding the simulator use interrupts.hpp.
+ * @date September 30th, 2024
+ * @author John Khalife, Stavros Karamalis
+*/
+
+#ifndef __INTERRUPTS_INTERNAL_H__
+#define __INTERRUPTS_INTERNAL_H__
+
+#include "interrupts.hpp"
+
+//dependencies
+#include <iostream>
+#include <type_traits>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <unordered_map>
+#include <deque>
+#include <queue>
+#include <vector>
+#include <set>
+#include <map>
+#include <cstdint>
+#include <climits>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <chrono>
+
+//This holds all of the memory structures used in this program
+namespace MemoryStructures {
+    const int PARTITION_SIZES[] = {40,25,15,10,8,2}; //The default partition layout
+    const int PARTITION_NUM = 6; 
+
+    //This structure represents a single partition
+    struct Partition {
+        uint partitionNum;
+        uint size;
+        int code; //holds the PID
+        uint start; //the first address of the partition
+        uint used; //the memory the owner actually needs, 0 when free
+    };
+
+    //This structure is a free list of the holes in a contiguous address space, ordered by address.
+    //It is a treap where every node also tracks the largest hole beneath it, so a first fit search is O(log n).
+    struct FreeList {
+        struct Node {
+            uint start;
+            uint size;
+            uint largest; //the largest hole in this subtree
+            uint priority;
+            Node* left;
+            Node* right;
+        };
+        Node* root = nullptr;
+        std::set<std::pair<uint, uint>> bySize; //(size, start) of every hole, for best fit
+
+        FreeList() = default;
+        ~FreeList();
+        //The list owns its nodes, so it can be moved but not copied
+        FreeList(const FreeList&) = delete;
+        FreeList& operator=(const FreeList&) = delete;
+        FreeList(FreeList&& other);
+        FreeList& operator=(FreeList&& other);
+
+        /**
+         * This method adds a hole. It must not overlap any other hole.
+         * @param start - the first address of the hole
+         * @param size - the size of the hole
+        */
+        void insert(uint start, uint size);
+
+        /**
+         * This method removes the hole starting at an address
+         * @param start - the first address of the hole
+        */
+        void erase(uint start);
+
+        /**
+         * This method finds the lowest addressed hole that starts at or after an address and is big enough
+         * @param size - the size needed
+         * @param from - the lowest address to consider
+         * @return the hole, or nullptr if there is none
+        */
+        Node* firstFit(uint size, uint from) const;
+
+        /**
+         * This method finds the smallest hole that is big enough, the lowest addressed one if there is a tie
+         * @param size - the size needed
+         * @return the hole, or nullptr if there is none
+        */
+        Node* bestFit(uint size) const;
+
+        /**
+         * This method finds the hole with the highest start address below an address
+         * @param address - the address to search below
+         * @return the hole, or nullptr if there is none
+        */
+        Node* before(uint address) const;
+
+        /**
+         * This method finds the hole that starts exactly at an address
+         * @param address - the address to search for
+         * @return the hole, or nullptr if there is none
+        */
+        Node* at(uint address) const;
+
+        uint largest() const { return root == nullptr ? 0 : root->largest; }
+    };
+
+    //This structure holds the memory, either as a fixed set of partitions or as a contiguous address space
+    //that processes carve their partitions out of.
+    struct Memory {
+        MemoryMode mode;
+        uint totalSize; //the size of the address space
+        uint freeMemory; //the memory not held by any process
+        uint usedMemory = 0; //the memory the processes holding partitions actually need
+        std::vector<Partition> partitions; //the fixed partitions
+        std::set<std::pair<uint, int>> freePartitions; //(size, -index) pairs so the best fit is the lower bound of the size needed
+        std::map<uint, Partition> blocks; //dynamic allocations by start address
+        FreeList holes; //the free memory when using first, next or best fit
+        std::vector<std::set<uint>> buddyBlocks; //the free block addresses of each order when using buddy allocation
+        uint nextFitStart = 0; //where the next fit search starts from
+
+        /**
+         * This constructor creates a partition for each size given, numbered from 1 in the order given.
+         * The partitions can be in any order. Partitions of equal size are handed out from the highest number down.
+         * @param sizes - the size of every partition
+        */
+        Memory(const std::vector<uint>& sizes);
+
+        /**
+         * This constructor creates an empty address space for dynamic partitioning
+         * @param mode - the allocator to use
+         * @param totalSize - the size of the address space
+        */
+        Memory(MemoryMode mode, uint totalSize);
+
+        /**
+         * This method hands out a partition for a process
+         * @param size - the amount of memory needed
+         * @param pid - the process the partition is for
+         * @return the partition, or nullptr if no free memory is big enough.
+        */
+        Partition* allocate(uint size, int pid);
+
+        /**
+         * This method frees a partition, merging it with any neighbouring free memory
+         * @param partition - the partition to free
+        */
+        void release(Partition* partition);
+
+        /**
+         * This method returns the size of the largest piece of free memory
+         * @return the largest partition or hole that is free
+        */
+        uint largestFree() const;
+
+        /**
+         * This method checks whether a process would get memory right now, without reserving any
+         * @param size - the size of the process
+         * @return true if allocate would succeed
+        */
+        bool fits(uint size) const;
+
+        bool hasFree() const { return (mode == FIXED) ? !freePartitions.empty() : freeMemory > 0; }
+        bool inUse() const { return (mode == FIXED) ? freePartitions.size() != partitions.size() : !blocks.empty(); }
+    };
+
+    //This structure is an intrusive doubly linked list holding every process in one state.
+    //Adding and removing a process is constant time, and removing a process does not disturb the others
+    //so it is safe to move a process while iterating as long as the next entry is read beforehand.
+    struct StateQueue {
+        pcb_t* head = nullptr;
+        pcb_t* tail = nullptr;
+        size_t count = 0;
+
+        //This iterator walks the list from front to back
+        struct iterator {
+            pcb_t* current;
+            pcb_t* operator*() const { return current; }
+            iterator& operator++() { current = current->next; return *this; }
+            bool operator!=(const iterator& other) const { return current != other.current; }
+        };
+
+        bool empty() const { return head == nullptr; }
+        size_t size() const { return count; }
+        pcb_t* front() const { return head; }
+        iterator begin() const { return iterator{head}; }
+        iterator end() const { return iterator{nullptr}; }
+
+        /**
+         * This method links a process onto the back of the list
+         * @param process - the process to add, which must not be in any list
+        */
+        void push_back(pcb_t* process);
+
+        /**
+         * This method links a process onto the front of the list
+         * @param process - the process to add, which must not be in any list
+        */
+        void push_front(pcb_t* process);
+
+        /**
+         * This method unlinks a process from the list
+         * @param process - the process to remove, which must be in this list
+        */
+        void remove(pcb_t* process);
+    };
+
+    //This structure represents an execution order
+    //It is responsible for stating what process should be executed and for how long
+    struct ExecutionOrder {
+        pcb_t* process;
+        int time;
+        ExecutionOrder() : process(nullptr), time(0) {}
+    };
+}
+
+//These functions and structures are responsible for getting input for the program and parsing it.
+namespace Parsing {
+    const int ARGUMENT_NUM = 3; // The number of required arguments in the program + 1
+    const char WORKLOAD_MAGIC[8] = {'S', 'I', 'M', 'W', 'L', 'O', 'A', 'D'}; //Marks a binary workload file
+    const uint32_t WORKLOAD_VERSION = 1; //The binary workload format version written by this program
+    const char SNAPSHOT_MAGIC[8] = {'S', 'I', 'M', 'S', 'N', 'A', 'P', '\0'}; //Marks a simulation snapshot
+    const uint32_t SNAPSHOT_VERSION = 2; //The snapshot format version written by this program
+
+    //This structure is the header at the start of a binary workload file.
+    //Everything in the file is in the native (little endian) byte order.
+    struct WorkloadHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t recordSize; //the size of each record, so readers can reject a layout they do not know
+        uint64_t recordCount;
+        uint32_t minArrival; //the earliest arrival time of any process
+        uint32_t maxArrival; //the latest arrival time of any process
+    };
+
+    //This structure is a single process in a binary workload file. The records follow the header back to back.
+    struct WorkloadRecord {
+        uint32_t pid;
+        uint32_t memorySize;
+        uint32_t arrivalTime;
+        uint32_t totalCPUTime;
+        uint32_t ioFrequency;
+        uint32_t ioDuration;
+    };
+
+    static_assert(sizeof(WorkloadHeader) == 32, "the workload header layout is part of the file format");
+    static_assert(sizeof(WorkloadRecord) == 24, "the workload record layout is part of the file format");
+
+    //This writes a snapshot of a simulation. Values are written as their bytes in memory, so a snapshot can only
+    //be restored by the same build of the program.
+    class SnapshotWriter {
+        std::ofstream file;
+        std::string fileName;
+    public:
+        /**
+         * This constructor creates the snapshot file and writes its header. Exits the program if it cannot be created.
+         * @param fileName - the snapshot file
+        */
+        SnapshotWriter(std::string fileName);
+
+        template <typename T>
+        void put(const T& value) {
+            static_assert(std::is_trivially_copyable<T>::value, "only plain values can be written as bytes");
+            file.write((const char*) &value, sizeof(T));
+        }
+
+        template <typename T>
+        void putVector(const std::vector<T>& values) {
+            static_assert(std::is_trivially_copyable<T>::value, "only plain values can be written as bytes");
+            put<uint64_t>(values.size());
+            file.write((const char*) values.data(), values.size() * sizeof(T));
+        }
+
+        void putString(const std::string& text);
+
+        /**
+         * This method finishes the snapshot. Exits the program if anything could not be written.
+        */
+        void close();
+    };
+
+    //This reads a snapshot back in the order it was written. A snapshot that ends early is an error.
+    class SnapshotReader {
+        std::ifstream file;
+        std::string fileName;
+        void check();
+    public:
+        /**
+         * This constructor opens a snapshot and checks its header. Exits the program if it is not a snapshot.
+         * @param fileName - the snapshot file
+        */
+        SnapshotReader(std::string fileName);
+
+        template <typename T>
+        T get() {
+            static_assert(std::is_trivially_copyable<T>::value, "only plain values can be read as bytes");
+            T value;
+            file.read((char*) &value, sizeof(T));
+            check();
+            return value;
+        }
+
+        template <typename T>
+        std::vector<T> getVector() {
+            static_assert(std::is_trivially_copyable<T>::value, "only plain values can be read as bytes");
+            std::vector<T> values(get<uint64_t>());
+            file.read((char*) values.data(), values.size() * sizeof(T));
+            check();
+            return values;
+        }
+
+        std::string getString();
+    };
+
+    /**
+     * This function writes the options a simulation was started with to a snapshot
+     * @param snapshot - the snapshot being written
+     * @param options - the options, with the output directory of the simulation in place of the batch one
+    */
+    void writeSnapshotOptions(SnapshotWriter& snapshot, const Options& options);
+
+    /**
+     * This function reads the options a simulation was started with from a snapshot
+     * @param snapshot - the snapshot being read
+     * @return the options
+    */
+    Options readSnapshotOptions(SnapshotReader& snapshot);
+
+    /**
+     * This function reads a list of partition sizes separated by commas or whitespace.
+     * Exits the program if any size is not a positive number.
+     * @param text - the list of sizes
+     * @return the partition sizes in the order given
+    */
+    std::vector<uint> parsePartitionSizes(std::string text);
+
+    /**
+     * This function reads the value of a flag that takes a single positive number.
+     * Exits the program if the value is anything else.
+     * @param flag - the flag, which the error message names
+     * @param text - the value given to the flag
+     * @return the value
+    */
+    uint parsePositive(std::string flag, std::string text);
+
+    /**
+     * This function reads a value of a flag that takes a time, which may be 0.
+     * Exits the program if the value is anything else.
+     * @param flag - the flag, which the error message names
+     * @param text - the value given to the flag
+     * @return the value
+    */
+    int parseNonNegative(std::string flag, std::string text);
+
+    /**
+     * This function reads a list of partition layouts separated by slashes, each a list of partition sizes.
+     * @param text - the layouts, like 500,250,150/300,300,300
+     * @return the layouts in the order given
+    */
+    std::vector<std::vector<uint>> parseLayouts(std::string text);
+
+    /**
+     * This function reads a partition layout from a file holding a list of partition sizes.
+     * @param fileName - the file to read the layout from
+     * @return the partition sizes in the order given
+    */
+    std::vector<uint> loadPartitionSizes(std::string fileName);
+
+    /**
+     * This function reads the name of a memory mode
+     * @param name - fixed, first-fit, next-fit, best-fit or buddy
+     * @return the memory mode. Exits the program if the name is unknown.
+    */
+    MemoryStructures::MemoryMode parseMemoryMode(std::string name);
+
+    /**
+     * This function checks the name of a scheduling strategy given to a flag
+     * @param name - FCFS, EP, RR, SJF, SRTF, MLFQ or CFS
+     * @return the name. Exits the program if the name is unknown.
+    */
+    std::string parseStrategy(std::string name);
+
+    /**
+     * This function parses a text workload in a single pass. Every line holds six comma separated numbers.
+     * Blank lines are ignored, anything else that is not six numbers is an error.
+     * @param begin - the start of the text
+     * @param end - the end of the text
+     * @param fileName - the name of the file, for error messages
+     * @return the pcb table
+    */
+    std::vector<MemoryStructures::PcbEntry> parseTextWorkload(const char* begin, const char* end, std::string fileName);
+
+    /**
+     * This function reads a binary workload, which is just a header followed by fixed width records.
+     * @param begin - the start of the file
+     * @param end - the end of the file
+     * @param fileName - the name of the file, for error messages
+     * @return the pcb table
+    */
+    std::vector<MemoryStructures::PcbEntry> readBinaryWorkload(const char* begin, const char* end, std::string fileName);
+
+    //This class reads a workload one process at a time, so it can be simulated while it is still being written to
+    //a pipe or the standard input. Binary workloads are recognized by their header and read until the input ends,
+    //whatever their record count says. The processes must come in arrival order.
+    class WorkloadStream {
+        std::ifstream file; //the input, unless it is the standard input
+        std::istream* input;
+        std::string fileName;
+        bool binary = false;
+        int line = 0; //the last line read, for error messages
+        uint lastArrival = 0;
+    public:
+        /**
+         * This constructor opens the input and reads the header of a binary workload. Exits the program if the
+         * input cannot be opened.
+         * @param fileName - the file or pipe to read from, - for the standard input
+        */
+        WorkloadStream(std::string fileName);
+
+        /**
+         * This method reads the next process, waiting for it to be written if it is not there yet.
+         * Exits the program if the process is invalid or arrives before the one read last.
+         * @param process - where the process goes, only its input fields are set
+         * @return false once the input has ended
+        */
+        bool next(MemoryStructures::PcbEntry& process);
+    };
+
+    /**
+     * This function converts a text workload to binary or a binary workload to text, whichever the input is not.
+     * @param inputFile - the workload to convert
+     * @param outputFile - where to write the converted workload
+    */
+    void convertWorkload(std::string inputFile, std::string outputFile);
+
+    /**
+     * This method takes the filename of the input file given, and grabs all student ids. it does this so that
+     * the output files can have the same ids and can be correlated with each other.
+     * @param fileName - the filename that was passed to the script before running
+     * @return A list of student numbers to be put into the output files.
+    */
+    std::deque<std::string> grabStudentNumbers(std::string fileName);
+
+    /**
+     * This method takes a filename and returns the name of an output file
+     * @param prefix - the prefix to add before the student names
+     * @param fileName - the name of the input file
+     * @param extension - the extension of the output file
+     * @return a string containing the name of the execution file
+    */
+    std::string getOutputFilename(std::string prefix, std::string fileName, std::string extension = ".txt");
+};
+
+//All functions in this namespace are responsible for writing the output tables
+namespace Output {
+    const size_t BUFFER_SIZE = 1 << 20; //How much output is held in memory before it is written to a file
+    const size_t RING_SIZE = 1 << 12; //The number of records the background writer can fall behind by
+    const size_t TRACE_BATCH = RING_SIZE / 4; //The records that wake the background writer up to write them
+    const size_t TEXT_RING_SIZE = 1 << 16; //The bytes of text the background writer can fall behind by
+    const int GANTT_WIDTH = 1600; //The width of the time axis of a Gantt chart in pixels
+    const int GANTT_ROW_HEIGHT = 30; //The height of each row of a Gantt chart in pixels
+    const int GANTT_LABEL_WIDTH = 60; //The room left of a Gantt chart for the row names
+    const int GANTT_LABEL_MIN_WIDTH = 24; //How wide a box has to be for the pid to be written in it
+    const int GANTT_MARGIN = 20; //The space above and right of a Gantt chart
+    const int GANTT_AXIS_HEIGHT = 30; //The space below a Gantt chart for the time labels
+
+    //This is a file that is only written to in large blocks. Lines are never flushed on their own.
+    class BufferedFile {
+        std::ofstream file;
+        std::string buffer;
+        uint64_t written = 0; //the bytes already in the file
+    public:
+        /**
+         * This method opens the file
+         * @param fileName - the file
+         * @param append - whether to keep what is in the file and write after it
+         * @return true if the file was opened
+        */
+        bool open(std::string fileName, bool append = false);
+        uint64_t size() const { return written + buffer.size(); }
+        bool fail() const { return !file.is_open() || file.fail(); }
+        void append(const char* text, size_t length);
+        void append(std::string_view text) { append(text.data(), text.size()); }
+        void appendRight(const char* text, size_t length, size_t width); //like std::setw with std::right
+        void appendRight(std::string_view text, size_t width) { appendRight(text.data(), text.size(), width); }
+        void appendRight(long value, size_t width);
+        void flush();
+        void close();
+    };
+
+    //These are the kinds of things the simulator can ask to have written
+    enum RecordKind {
+        EXECUTION_STEP,
+        MEMORY_STATUS,
+        EXECUTION_TEXT, //a line of the execution table that is already formatted, like a header
+        MEMORY_TEXT //a line of the memory status table that is already formatted
+    };
+
+    //This structure is a single line of output before it has been formatted.
+    //Only the fields used by its kind are filled in.
+    struct TraceRecord {
+        RecordKind kind;
+        int time;
+        uint pid;
+        MemoryStructures::ProcessState from;
+        MemoryStructures::ProcessState to;
+        int cpu; //the CPU column, -1 when there is only one CPU
+        int memAllocated;
+        int totalFreeMemory;
+        int usableFreeMemory;
+        bool showFragmentation;
+        double fragmentation;
+        uint32_t textLength; //the length of the partition state, or of the whole line for the text kinds
+    };
+
+    //This structure is how far the tables of a simulation had been written, so a restored simulation can carry on from there
+    struct TracePosition {
+        std::string executionFileName;
+        std::string memoryStatusFileName;
+        uint64_t executionSize = 0;
+        uint64_t memoryStatusSize = 0;
+    };
+
+    //This is a single producer, single consumer ring of records. The simulator is the only producer and the
+    //background writer the only consumer, so the two indices are all the synchronization that is needed.
+    class RecordRing {
+        std::vector<TraceRecord> slots;
+        alignas(64) std::atomic<size_t> head{0}; //the next slot to read, only written by the consumer
+        alignas(64) std::atomic<size_t> tail{0}; //the next slot to write, only written by the producer
+    public:
+        RecordRing() : slots(RING_SIZE) {}
+        bool push(const TraceRecord& record);
+        bool pop(TraceRecord& record);
+        size_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+    };
+
+    //This is a queue of bytes between one producer and one consumer. It carries the text of the records, in the
+    //same order, so the records themselves hold no strings and nothing is allocated per record.
+    class TextRing {
+        std::vector<char> bytes;
+        alignas(64) std::atomic<size_t> head{0}; //the next byte to read, only written by the consumer
+        alignas(64) std::atomic<size_t> tail{0}; //the next byte to write, only written by the producer
+    public:
+        TextRing() : bytes(TEXT_RING_SIZE) {}
+
+        /**
+         * This function copies as much of some text into the ring as fits
+         * @param text - the text
+         * @param length - its length
+         * @return how much was copied
+        */
+        size_t push(const char* text, size_t length);
+
+        /**
+         * This function moves as much text out of the ring as there is, up to a length
+         * @param text - what the text is appended to
+         * @param length - the most to take
+         * @return how much was taken
+        */
+        size_t pop(std::string& text, size_t length);
+    };
+
+    //This writes the execution and memory status tables. Records are formatted and written either straight away
+    //into the buffers, or by a background thread when the writer is asynchronous.
+    class TraceWriter {
+        BufferedFile execution;
+        BufferedFile memoryStatus;
+        bool async = false;
+        RecordRing ring;
+        TextRing textRing;
+        std::thread worker;
+        std::atomic<bool> finished{false};
+        std::atomic<bool> sleeping{false}; //whether the background thread is waiting to be woken
+        std::mutex wakeLock;
+        std::condition_variable wake;
+        std::string text; //the text of the record the background thread is formatting, kept to reuse its memory
+        bool opened = false; //nothing is written until the files are opened
+        std::string executionFileName;
+        std::string memoryStatusFileName;
+        void submit(TraceRecord& record, std::string_view text);
+        void format(const TraceRecord& record, std::string_view text);
+        void drain();
+        void wakeWorker();
+    public:
+        /**
+         * This function opens both output files
+         * @param executionFileName - the execution table file
+         * @param memoryStatusFileName - the memory status table file
+         * @param background - whether formatting and writing happens on a background thread
+        */
+        void open(std::string executionFileName, std::string memoryStatusFileName, bool background);
+
+        /**
+         * This function opens both output files to carry on where a snapshot left off. Each file keeps the first part
+         * of the file the snapshot was taken from, copying it over first if it is a different file.
+         * @param executionFileName - the execution table file
+         * @param memoryStatusFileName - the memory status table file
+         * @param background - whether formatting and writing happens on a background thread
+         * @param from - where the tables were when the snapshot was taken
+        */
+        void resume(std::string executionFileName, std::string memoryStatusFileName, bool background, const TracePosition& from);
+
+        /**
+         * This function writes out everything submitted so far and returns where both files are up to
+         * @return the position, with empty file names if the files are not open
+        */
+        TracePosition position();
+        bool executionFailed() const { return execution.fail(); }
+        bool memoryStatusFailed() const { return memoryStatus.fail(); }
+        void executionStep(int time, uint pid, MemoryStructures::ProcessState from, MemoryStructures::ProcessState to, int cpu);
+        void memoryStatusLine(int time, int memAllocated, std::string_view memoryState, int totalFreeMemory, int usableFreeMemory, bool showFragmentation, double fragmentation);
+        void executionText(std::string_view line);
+        void memoryText(std::string_view line);
+        /**
+         * This function writes everything that is left, stops the background thread and closes both files
+        */
+        void close();
+    };
+
+    //This writes the Gantt intervals: a line for every stretch of time a process spent running or doing IO,
+    //written as the process leaves the state so nothing is kept in memory.
+    class GanttWriter {
+        BufferedFile file;
+        bool opened = false; //nothing is written until the file is opened
+        bool multiCore = false; //whether the lines have a CPU column
+        std::string fileName;
+    public:
+        /**
+         * This function opens the intervals file and writes its header
+         * @param fileName - the intervals file
+         * @param multiCore - whether there are several CPUs, so each interval says which CPU it was on
+        */
+        void open(std::string fileName, bool multiCore);
+
+        /**
+         * This function opens the intervals file to carry on where a snapshot left off, the same way as the tables
+         * @param fileName - the intervals file
+         * @param multiCore - whether there are several CPUs
+         * @param sourceName - the intervals file of the snapshot
+         * @param size - how much of it had been written
+        */
+        void resume(std::string fileName, bool multiCore, std::string sourceName, uint64_t size);
+
+        /**
+         * This function writes out everything so far and returns how much of the file has been written
+         * @return the size of the file, 0 if it is not open
+        */
+        uint64_t position();
+        bool isOpen() const { return opened; }
+        std::string name() const { return fileName; }
+
+        /**
+         * This function writes a single interval. Empty intervals are left out.
+         * @param pid - the process
+         * @param state - RUNNING or WAITING
+         * @param start - when the process entered the state
+         * @param end - when it left
+         * @param cpu - the CPU a running process was on, -1 for IO or when there is only one CPU
+        */
+        void interval(uint pid, MemoryStructures::ProcessState state, int start, int end, int cpu);
+        void close();
+    };
+
+    /**
+     * This function draws a Gantt chart from an intervals file. Every CPU gets a row for what it ran and the IO of all
+     * processes shares one more row. The file is read twice, once to size the chart and once to draw it, and
+     * intervals narrower than a pixel are merged, so even millions of intervals are drawn without keeping them.
+     * @param intervalFile - the intervals written by a simulation
+     * @param chartFile - the chart, an HTML page if it ends in .html and an SVG image otherwise
+    */
+    void renderGantt(std::string intervalFile, std::string chartFile);
+
+    const char INDEX_MAGIC[8] = {'S', 'I', 'M', 'I', 'N', 'D', 'E', 'X'}; //Marks an execution table index
+    const uint32_t INDEX_VERSION = 1; //The index format version written by this program
+    const uint64_t INDEX_STRIDE = 1024; //The rows between the records of what every CPU is running
+    const uint64_t NO_ROW = UINT64_MAX; //Ends the rows of a pid, and marks an idle CPU
+
+    //This is the start of an index file. It is followed by the rows, then a checkpoint for every INDEX_STRIDE rows,
+    //then the pids. A checkpoint is the row each CPU was dispatched by, before the rows from there on.
+    struct IndexHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t cpus; //the number of CPUs, so the size of a checkpoint
+        uint64_t tableSize; //the size of the execution table that was indexed, to notice when it has changed
+        uint64_t rows;
+        uint64_t pids;
+    };
+
+    //This is a row of the execution table. The rows are in the order of the table, so also in order of time.
+    struct IndexRow {
+        uint64_t offset; //where the row starts in the execution table
+        uint64_t previous; //the row before it with the same pid, NO_ROW for the first
+        int32_t time;
+        int32_t pid;
+    };
+
+    //This is where the rows of a single pid end. The pids are sorted.
+    struct IndexPid {
+        int32_t pid;
+        uint32_t count; //how many rows it has
+        uint64_t last; //its last row
+    };
+
+    static_assert(sizeof(IndexHeader) == 40, "the index header layout is part of the file format");
+    static_assert(sizeof(IndexRow) == 24, "the index row layout is part of the file format");
+    static_assert(sizeof(IndexPid) == 16, "the index pid layout is part of the file format");
+
+    /**
+     * This function returns the name of the index of an execution table, which is next to it
+     * @param tableFile - the execution table
+     * @return the table with its extension replaced by .idx
+    */
+    std::string indexFilename(std::string tableFile);
+
+    /**
+     * This function indexes an execution table, reading it once from start to end
+     * @param tableFile - the execution table
+     * @param indexFile - where the index goes
+    */
+    void indexExecution(std::string tableFile, std::string indexFile);
+
+    /**
+     * This function answers a question about an execution table from its index. Only the rows in the answer and the
+     * parts of the index that lead to them are read, so it takes the same time however long the table is.
+     * @param tableFile - the execution table, which has to have been indexed since it was last written
+     * @param query - --at=<time> for what every CPU was running, --range=<start>,<end> for the rows between two times
+     * or --pid=<pid> for every row of a process
+    */
+    void queryExecution(std::string tableFile, std::string query);
+};
+
+//All functions in this namespace are responsible for the scheduling metrics
+namespace Metrics {
+    const int SUB_BUCKET_BITS = 7; //Values are kept to 7 significant bits, so a reported percentile is within 1% of the truth
+    const int HISTOGRAM_BUCKETS = (32 - SUB_BUCKET_BITS + 2) << (SUB_BUCKET_BITS - 1); //enough for any int
+
+    //This class is a log-linear histogram of non-negative times. Small values are counted exactly and larger ones
+    //in buckets that grow with the value, so its size is fixed no matter how many values are recorded.
+    class Histogram {
+        std::array<unsigned long, HISTOGRAM_BUCKETS> counts{};
+        unsigned long total = 0;
+        int maxValue = 0;
+        static int bucketOf(int value);
+        static int highestIn(int bucket); //the largest value that lands in a bucket
+    public:
+        /**
+         * This method records a single value
+         * @param value - the value, negative values count as 0
+        */
+        void record(int value);
+
+        /**
+         * This method adds every value recorded in another histogram to this one
+         * @param other - the histogram to add
+        */
+        void merge(const Histogram& other);
+
+        void save(Parsing::SnapshotWriter& snapshot) const;
+        void restore(Parsing::SnapshotReader& snapshot);
+
+        /**
+         * This method returns the value that the given share of recorded values are at or below
+         * @param percent - the percentile, between 0 and 100
+         * @return the percentile, or 0 if nothing was recorded
+        */
+        int percentile(double percent) const;
+
+        int max() const { return maxValue; }
+        unsigned long count() const { return total; }
+    };
+
+    //This structure holds a histogram of each of the times that are reported with percentiles
+    struct LatencyHistograms {
+        Histogram waitTime;
+        Histogram turnaroundTime;
+        Histogram responseTime;
+
+        void merge(const LatencyHistograms& other);
+    };
+
+    const double REPORTED_PERCENTILES[] = {50, 90, 99, 99.9}; //reported along with the maximum
+    const char* const PERCENTILE_NAMES[] = {"p50", "p90", "p99", "p999"};
+    //This structure holds what is known about a single process. Times are -1 until they happen.
+    struct ProcessMetrics {
+        uint pid;
+        int arrivalTime = -1; //when the process was first loaded into memory and became ready
+        int startTime = -1; //when the process first ran
+        int completionTime = -1; //when the process terminated
+        int waitingTime = 0; //the total time spent ready but not running
+        int readySince = 0; //when the process last became ready
+        bool retired = false; //whether the row is free because the process was streamed and has been retired
+    };
+
+    //This structure holds the metrics of a single CPU
+    struct CoreMetrics {
+        unsigned long busyTime = 0; //the time spent running processes
+        unsigned long dispatches = 0; //the bursts run
+        unsigned long steals = 0; //the bursts taken from another CPU's queue
+        unsigned long completed = 0; //the processes that terminated on this CPU
+    };
+
+    //This structure holds the metrics of a whole run
+    struct Summary {
+        uint completed; //the processes that arrived and terminated, only these are averaged
+        int totalTime; //the time of the last transition
+        double throughput; //completed processes per unit of time
+        double avgWaitTime;
+        double avgTurnaroundTime;
+        double avgResponseTime;
+    };
+
+    //This class works the metrics out from the state transitions as they are made, with constant work per transition.
+    class Collector {
+        std::vector<ProcessMetrics> processes; //in the same order as the pcb table
+        int lastTransition = 0;
+        unsigned long transitionCount = 0;
+        uint completed = 0;
+        long totalWaitTime = 0;
+        long totalTurnaroundTime = 0;
+        long totalResponseTime = 0;
+        LatencyHistograms latencies;
+        std::vector<CoreMetrics> cores;
+    public:
+        /**
+         * This method starts collecting metrics for a pcb table
+         * @param pcbTable - the processes being simulated
+         * @param cpus - the number of CPUs
+        */
+        void reset(const std::vector<MemoryStructures::PcbEntry>& pcbTable, uint cpus = 1);
+
+        /**
+         * This method records a burst starting on a CPU
+         * @param core - the CPU
+         * @param stolen - whether the process was taken from another CPU's queue
+        */
+        void dispatch(int core, bool stolen);
+
+        /**
+         * This method records a burst ending on a CPU
+         * @param core - the CPU
+         * @param time - how long the burst ran for, which is shorter than planned if it was preempted
+        */
+        void coreRan(int core, int time) { cores[core].busyTime += time; }
+
+        /**
+         * This method records a process terminating on a CPU
+         * @param core - the CPU
+        */
+        void coreCompleted(int core) { cores[core].completed++; }
+
+        /**
+         * This method starts collecting metrics for a streamed process
+         * @param index - the slot the process is kept in, which may be a retired process's slot
+         * @param pid - the process
+        */
+        void admit(size_t index, uint pid);
+
+        /**
+         * This method frees the row of a streamed process that has terminated. It is already in the totals, so
+         * only the per-process output loses it.
+         * @param index - the slot the process was kept in
+        */
+        void retire(size_t index);
+
+        const std::vector<CoreMetrics>& perCore() const { return cores; }
+
+        /**
+         * This method records a state transition
+         * @param index - the position of the process in the pcb table
+         * @param time - when the transition happened
+         * @param from - the state the process left
+         * @param to - the state the process entered
+        */
+        void transition(size_t index, int time, MemoryStructures::ProcessState from, MemoryStructures::ProcessState to);
+
+        /**
+         * This method returns the metrics of the run so far
+         * @return the summary
+        */
+        Summary summarize() const;
+
+        const std::vector<ProcessMetrics>& perProcess() const { return processes; }
+        const LatencyHistograms& histograms() const { return latencies; }
+        unsigned long transitions() const { return transitionCount; }
+
+        /**
+         * This method writes the summary and every process as JSON
+         * @param fileName - the file to write to
+         * @param inputFile - the input that was simulated
+         * @param strategy - the strategy that was used
+        */
+        void writeJson(std::string fileName, std::string inputFile, std::string strategy) const;
+
+        /**
+         * This method writes the summary as a single CSV row and every process as a row of a second CSV file
+         * @param summaryFileName - the file the summary goes to
+         * @param processFileName - the file the processes go to
+         * @param inputFile - the input that was simulated
+         * @param strategy - the strategy that was used
+        */
+        void writeCsv(std::string summaryFileName, std::string processFileName, std::string inputFile, std::string strategy) const;
+
+        /**
+         * This method writes the names of the summary columns, each preceded by a comma
+         * @param output - the stream to write to
+        */
+        static void writeSummaryHeader(std::ostream& output);
+
+        /**
+         * This method writes everything collected so far to a snapshot
+         * @param snapshot - the snapshot being written
+        */
+        void save(Parsing::SnapshotWriter& snapshot) const;
+
+        /**
+         * This method replaces everything collected with what a snapshot holds
+         * @param snapshot - the snapshot being read
+        */
+        void restore(Parsing::SnapshotReader& snapshot);
+
+        /**
+         * This method writes the summary columns, each preceded by a comma
+         * @param output - the stream to write to
+        */
+        void writeSummaryRow(std::ostream& output) const;
+
+        /**
+         * This method writes a row for every CPU and one for all of them together as CSV
+         * @param fileName - the file to write to
+        */
+        void writeCoreCsv(std::string fileName) const;
+    };
+
+    /**
+     * This function writes the percentiles of every strategy as CSV, one row per strategy and time
+     * @param fileName - the file to write to
+     * @param strategies - the strategies, in the same order as the histograms
+     * @param histograms - the histograms of every strategy
+    */
+    void writePercentiles(std::string fileName, const std::vector<std::string>& strategies, const std::vector<LatencyHistograms>& histograms);
+};
+
+//All functions in this namespace are responsible for profiling the simulator itself. Nothing is measured unless the
+//program is built with -DSIM_PROFILE, otherwise the macros below compile to nothing. A call that is only counted costs
+//a decrement and a branch, under a nanosecond, which keeps a profiled run within 1% of a normal one on the sample inputs.
+//Counters bumped in tight loops are added up locally and added to the profile once, with PROFILE_ADD.
+namespace Profiling {
+    const uint32_t SAMPLE_RATE = 256; //On average one call in this many is timed, the rest are only counted. Must be a power of two.
+
+    //These are the parts of the simulator that are timed. A section includes the time of any sections it calls.
+    enum Section {
+        GET_EXECUTION_ORDER,
+        RESERVE_MEMORY,
+        LOAD_MEMORY,
+        CHECK_ARRIVED,
+        DO_IO,
+        CHANGE_STATE,
+        EXECUTION_WRITER,
+        MEMORY_STATUS_WRITER,
+        NUM_SECTIONS
+    };
+
+    const char* const SECTION_NAMES[NUM_SECTIONS] = {"get_execution_order", "reserve_memory", "load_memory", "check_arrived", "do_io", "change_state", "execution_writer", "memory_status_writer"};
+
+    /**
+     * This function reads the cheapest clock there is, the time stamp counter on x86 and a steady clock otherwise
+     * @return the time in clock ticks, which are only turned into nanoseconds when the profile is written
+    */
+    inline uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __builtin_ia32_rdtsc(); //the compiler builtin, so the intrinsics header stays out of this one
+#else
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+    }
+
+    //This structure is how often a section ran and how long the timed calls took. The calls between timed ones
+    //are counted down rather than up, which is the only work an untimed call does.
+    struct SectionStats {
+        uint32_t countdown = 1; //the calls left until the next timed one, so the first call is timed
+        uint32_t seed = 2463534242; //picks the gaps between timed calls, so they cannot fall into step with a loop
+        unsigned long scheduled = 1; //the calls counted down so far, including the ones still to come
+        unsigned long sampled = 0; //the calls that were timed
+        uint64_t sampledTicks = 0; //the clock ticks the timed calls took
+        unsigned long calls() const { return scheduled - countdown; }
+
+        /**
+         * This method sets how many calls there are until the next timed one, between 1 and twice the sample rate
+        */
+        void reschedule() {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            countdown = 1 + (seed & (2 * SAMPLE_RATE - 1));
+            scheduled += countdown;
+        }
+    };
+
+    /**
+     * This function adds a timed call to the stats of its section and picks the next call to time. It is kept out of
+     * line so that a call that is only counted inlines to a decrement and a branch.
+     * @param stats - the stats of the section
+     * @param ticks - the clock ticks the call took
+    */
+    [[gnu::cold, gnu::noinline]] void addSample(SectionStats& stats, uint64_t ticks);
+
+    //This class times a section from where it is made to the end of the scope, if the call is one that is sampled
+    class ScopedTimer {
+        SectionStats& stats;
+        uint64_t start = 0;
+    public:
+        ScopedTimer(SectionStats& stats) : stats(stats) {
+            if (__builtin_expect(--stats.countdown == 0, 0)) {
+                start = now();
+            }
+        }
+        ~ScopedTimer() {
+            if (__builtin_expect(start != 0, 0)) {
+                addSample(stats, now() - start);
+            }
+        }
+    };
+
+    //This class is the profile of a single simulation
+    class Profile {
+        uint64_t startTicks = 0;
+        std::chrono::steady_clock::time_point startTime;
+        uint64_t timerTicks = 0; //what reading the clock twice costs, which is taken off every timed call
+    public:
+        std::array<SectionStats, NUM_SECTIONS> sections;
+        std::array<size_t, MemoryStructures::TERMINATED + 1> highWater{}; //the longest each state list has been
+        unsigned long failedAdmissions = 0; //the times a process could not be given memory when loading
+
+        /**
+         * This method starts the clock the sections are compared against and measures the cost of timing a call
+        */
+        void start();
+
+        /**
+         * This method records the length of a state list, keeping the longest
+         * @param state - the state
+         * @param length - how many processes are in it now
+        */
+        void queueLength(MemoryStructures::ProcessState state, size_t length) {
+            highWater[state] = std::max(highWater[state], length);
+        }
+
+        /**
+         * This method writes the profile as JSON. The time of each section is estimated from its sampled calls.
+         * @param fileName - the file to write to
+         * @param inputFile - the input that was simulated
+         * @param strategy - the strategy that was used
+        */
+        void writeJson(std::string fileName, std::string inputFile, std::string strategy) const;
+    };
+};
+
+#ifdef SIM_PROFILE
+#define PROFILE_SCOPE(section) Profiling::ScopedTimer profileTimer(profile.sections[Profiling::section])
+#define PROFILE_COUNT(counter) (profile.counter++)
+#define PROFILE_ADD(counter, amount) (profile.counter += (amount))
+#define PROFILE_QUEUE(state, length) profile.queueLength(state, length)
+#else
+#define PROFILE_SCOPE(section)
+#define PROFILE_COUNT(counter)
+#define PROFILE_ADD(counter, amount) ((void) (amount))
+#define PROFILE_QUEUE(state, length)
+#endif
+
+//All functions in this namespace scan columns of times, which is what the simulator does on every tick.
+//Each scan has an AVX2 version that is used when the CPU has it, and a scalar one that gives the same answer.
+namespace Scan {
+    /**
+     * This function checks whether the AVX2 versions of the scans are the ones being used
+     * @return true if the CPU supports AVX2
+    */
+    bool usingAvx2();
+
+    /**
+     * This function counts how many times at the front of a column are due
+     * @param times - the column, which is sorted from earliest to latest
+     * @param count - the number of times in the column
+     * @param now - the current time
+     * @return the number of leading times that are at most now
+    */
+    size_t countDue(const int* times, size_t count, int now);
+
+    /**
+     * This function finds every time in a column that is due, and the earliest of the rest
+     * @param times - the column, in any order
+     * @param count - the number of times in the column
+     * @param now - the current time
+     * @param due - the positions of the due times are added to it, in increasing order
+     * @return the earliest time that is not due, INT_MAX if there is none
+    */
+    int collectDue(const int* times, size_t count, int now, std::vector<uint32_t>& due);
+
+    //The scalar versions, which the ones above fall back on
+    size_t countDueScalar(const int* times, size_t count, int now);
+    int collectDueScalar(const int* times, size_t count, int now, std::vector<uint32_t>& due);
+};
+
+//All functions in this namespace are responsible for execution
+namespace Execution {
+    const int QUANTUM = 100; //The time quantum for the round robin scheduler
+    const int MLFQ_LEVELS = 3; //The number of feedback queues, the last one runs bursts to completion
+    const int MLFQ_QUANTUM = 10; //The quantum of the top feedback queue, it doubles at each level below
+    const int MLFQ_BOOST = 200; //How often every process goes back to the top feedback queue, so none starves at the bottom
+    const int CFS_LATENCY = 48; //The period the fair scheduler tries to run every ready process in
+    const int CFS_MIN_SLICE = 4; //The shortest slice the fair scheduler hands out
+    const int NUM_STATES = 6; //The number of states in the program
+    const int IO_WINDOW_TICKS = 64; //How soon after starting IO has to finish to be kept in the scanned columns instead of the heap
+
+    using namespace MemoryStructures;
+
+    //These are the kinds of events that can wake up the event driven engine
+    //Arrivals and IO completions are not queued here since they have their own ordered queues
+    enum EventKind {
+        BURST_END,
+        QUANTUM_EXPIRY
+    };
+
+    //This structure represents a point in time where the state of the simulation may change.
+    //Events that turn out to be stale are harmless, they just cause an ordinary tick.
+    struct Event {
+        int time;
+        EventKind kind;
+        bool operator>(const Event& other) const { return time > other.time; }
+    };
+
+
+    //This structure is a single entry in a scheduling queue.
+    //Entries whose ticket no longer matches the process are stale and get skipped.
+    struct QueueEntry {
+        uint key; //what the strategy orders by
+        unsigned long ticket; //insertion order, keeps processes with equal keys in the order they were queued
+        pcb_t* process;
+        bool operator>(const QueueEntry& other) const {
+            return (key != other.key) ? key > other.key : ticket > other.ticket;
+        }
+    };
+
+    typedef std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> SchedulingQueue;
+
+    //This structure is a pending IO completion.
+    //Completions on the same tick are ordered by when the processes started waiting.
+    struct IoCompletion {
+        int time;
+        unsigned long sequence;
+        pcb_t* process;
+        bool operator>(const IoCompletion& other) const {
+            return (time != other.time) ? time > other.time : sequence > other.sequence;
+        }
+    };
+
+    //This structure holds the IO in progress. IO finishing within IO_WINDOW_TICKS of starting is kept as columns,
+    //one entry per waiting process in no particular order, and finding what has finished among it is a scan over the
+    //contiguous completion times rather than a walk down a heap. IO finishing later waits in a heap as before.
+    struct IoWaits {
+        std::vector<int> times; //when each IO in the window finishes
+        std::vector<unsigned long> sequences; //the order the processes started waiting in
+        std::vector<pcb_t*> processes; //the process waiting on each IO
+        std::priority_queue<IoCompletion, std::vector<IoCompletion>, std::greater<IoCompletion>> later; //the rest
+        std::vector<uint32_t> due; //the positions found by the last scan, kept to reuse its memory
+        size_t count = 0; //the IO in the columns and the heap
+        int earliest = INT_MAX; //the earliest completion, so a tick where nothing finishes does not scan
+
+        bool empty() const { return count == 0; }
+        size_t size() const { return count; }
+
+        /**
+         * This method adds an IO that has started
+         * @param completion - when it finishes, its sequence number and the process
+         * @param time - the time it started
+        */
+        void push(const IoCompletion& completion, int time);
+
+        /**
+         * This method takes out every IO that finishes by a time
+         * @param time - the time
+         * @param finished - cleared and then given the finished IO, earliest first and in the order the processes
+         * started waiting within a tick
+        */
+        void takeDue(int time, std::vector<IoCompletion>& finished);
+
+        /**
+         * This method returns every IO in progress without taking any out
+         * @return the IO, earliest first and in the order the processes started waiting within a tick
+        */
+        std::vector<IoCompletion> pending() const;
+    };
+
+    //This structure is a simulated CPU when there is more than one. Each CPU has its own ready queue.
+    struct Core {
+        pcb_t* running = nullptr; //the process on the CPU, nullptr when idle
+        int sliceEnd = 0; //when the running process leaves the CPU
+        ProcessState nextState = READY; //the state the running process leaves the CPU for
+        SchedulingQueue readyQueue; //the processes waiting for this CPU
+        uint queued = 0; //the number of live entries in the ready queue
+        int sliceStart = 0; //when the running process got the CPU
+    };
+
+    //The scheduling policies. A policy decides the order of the scheduling queues and how long each burst may run.
+    //The simulator takes the policy as a template parameter, so every call below is resolved and inlined at compile time.
+    //A policy only hides the members of Defaults it changes.
+    namespace Policies {
+        struct Defaults {
+            static constexpr bool preemptive = false; //whether a process that becomes ready can take the CPU mid burst
+
+            /**
+             * This method returns the key a process is ordered by in a scheduling queue, smallest first.
+             * Processes with equal keys keep the order they were queued in. Memory is loaded first come first serve.
+             * @param process - the process being queued
+             * @param state - the state the process is queued in, NEW or READY
+             * @return the key of the process
+            */
+            uint key(const pcb_t* process, ProcessState /*state*/) const { return process->arrivalTime; }
+
+            /**
+             * This method is told about a process entering the ready queue, before its key is worked out
+             * @param process - the process that became ready
+            */
+            void becameReady(pcb_t* /*process*/) {}
+
+            /**
+             * This method returns the longest a process may run before going back to the ready queue
+             * @param process - the process about to run
+             * @param waiting - the number of processes waiting for the same CPU, including this one
+             * @return the length of the slice
+            */
+            int slice(const pcb_t* process, size_t /*waiting*/) const { return process->ioFrequency; }
+
+            /**
+             * This method checks whether a process that is ready should take the CPU from the running one.
+             * It is only called when the policy is preemptive.
+             * @param ready - the front of the ready queue
+             * @param running - the running process
+             * @return true if the running process should be preempted
+            */
+            bool preempts(const pcb_t* /*ready*/, const pcb_t* /*running*/) const { return false; }
+
+            /**
+             * This method is told about every burst before the process leaves the CPU
+             * @param process - the process that ran
+             * @param ran - how long it ran for
+             * @param expired - whether it used its whole slice
+            */
+            void burstEnded(pcb_t* /*process*/, int /*ran*/, bool /*expired*/) {}
+
+            /**
+             * This method applies the options that tune the policy
+             * @param options - the options of the simulation
+            */
+            void configure(const Parsing::Options& /*options*/) {}
+
+            /**
+             * This method checks whether the processes are due a priority boost. It is checked before every pick from a ready queue.
+             * @param time - the current time
+             * @return true if every process should be boosted now
+            */
+            bool boostDue(int /*time*/) { return false; }
+
+            /**
+             * This method raises a process back to the highest priority. The simulator queues it again afterwards if it is ready.
+             * @param process - the process to boost
+            */
+            void boost(pcb_t* /*process*/) {}
+        };
+
+        //First come first serve, by arrival time until the process does IO
+        struct FCFS : Defaults {};
+
+        //External priority, the lowest pid goes first
+        struct EP : Defaults {
+            uint key(const pcb_t* process, ProcessState state) const { return (state == READY) ? process->pid : process->arrivalTime; }
+        };
+
+        //Round robin, in the order the processes became ready, for a fixed quantum
+        struct RR : Defaults {
+            int quantum = QUANTUM;
+            uint key(const pcb_t* /*process*/, ProcessState /*state*/) const { return 0; }
+            int slice(const pcb_t* /*process*/, size_t /*waiting*/) const { return quantum; }
+            void configure(const Parsing::Options& options) { quantum = (options.quantum != 0) ? options.quantum : QUANTUM; }
+        };
+
+        //Shortest job first, the shortest next burst goes first and runs until IO
+        struct SJF : Defaults {
+            uint key(const pcb_t* process, ProcessState state) const {
+                return (state == READY) ? std::min(process->ioFrequency, process->totalCPUTime) : process->arrivalTime;
+            }
+        };
+
+        //Shortest remaining time first, a process with less CPU time left takes the CPU as soon as it is ready
+        struct SRTF : Defaults {
+            static constexpr bool preemptive = true;
+            uint key(const pcb_t* process, ProcessState state) const { return (state == READY) ? process->totalCPUTime : process->arrivalTime; }
+            bool preempts(const pcb_t* ready, const pcb_t* running) const { return ready->totalCPUTime < running->totalCPUTime; }
+        };
+
+        //Multilevel feedback queue. Everything starts in the top queue, a process that uses its whole quantum drops a level
+        //and a process in a higher queue takes the CPU from one in a lower queue. Every process goes back to the top queue
+        //at the first pick of each boost period.
+        struct MLFQ : Defaults {
+            static constexpr bool preemptive = true;
+            int lastBoost = 0; //the start of the boost period the processes were last boosted in
+
+            uint key(const pcb_t* process, ProcessState state) const { return (state == READY) ? process->level : process->arrivalTime; }
+            int slice(const pcb_t* process, size_t /*waiting*/) const {
+                return (process->level + 1 < (uint) MLFQ_LEVELS) ? MLFQ_QUANTUM << process->level : process->ioFrequency;
+            }
+            bool preempts(const pcb_t* ready, const pcb_t* running) const { return ready->level < running->level; }
+            void burstEnded(pcb_t* process, int /*ran*/, bool expired) {
+                if (expired && process->level + 1 < (uint) MLFQ_LEVELS) {
+                    process->level++;
+                }
+            }
+            bool boostDue(int time) {
+                if (time - lastBoost < MLFQ_BOOST) {
+                    return false;
+                }
+                lastBoost = time - (time - lastBoost) % MLFQ_BOOST;
+                return true;
+            }
+            void boost(pcb_t* process) { process->level = 0; }
+        };
+
+        //Completely fair scheduling, the process that has been charged the least CPU time goes first.
+        //The latency is shared between the waiting processes, and a process that was away is placed at most half a latency
+        //behind the others so it cannot hog the CPU when it comes back.
+        struct CFS : Defaults {
+            uint minVruntime = 0; //the charge of the last process picked, which never decreases
+
+            uint key(const pcb_t* process, ProcessState state) const { return (state == READY) ? process->vruntime : process->arrivalTime; }
+            void becameReady(pcb_t* process) {
+                uint floor = (minVruntime > CFS_LATENCY / 2) ? minVruntime - CFS_LATENCY / 2 : 0;
+                process->vruntime = std::max(process->vruntime, floor);
+            }
+            int slice(const pcb_t* /*process*/, size_t waiting) const {
+                return std::max<int>(CFS_MIN_SLICE, CFS_LATENCY / std::max<size_t>(waiting, 1));
+            }
+            void burstEnded(pcb_t* process, int ran, bool /*expired*/) {
+                minVruntime = std::max(minVruntime, process->vruntime);
+                process->vruntime += ran;
+            }
+        };
+    }
+
+    //This class is a single simulation. It owns everything the simulation touches, its pcb table, memory, clock
+    //and output files, so any number of them can run at the same time on different threads.
+    //The scheduling policy is fixed when the class is instantiated, use withPolicy to pick it by name.
+    //This class is the simulation behind Simulator. It owns everything the simulation touches, its pcb table, memory,
+    //clock and output files, so any number of them can run at the same time on different threads.
+    template <typename Policy>
+    class SimulatorImpl {
+    public:
+        using TransitionCallback = typename Simulator<Policy>::TransitionCallback;
+
+        //These are the ones Simulator forwards to, they are documented there
+        SimulatorImpl(const Parsing::Options& options, std::string outputDirectory = "");
+        SimulatorImpl(const Parsing::Options& options, std::vector<pcb_t> workload, std::string outputDirectory = "");
+        SimulatorImpl(const Parsing::Options& options, Parsing::SnapshotReader& snapshot);
+        ~SimulatorImpl();
+        SimulatorImpl(const SimulatorImpl&) = delete;
+        SimulatorImpl& operator=(const SimulatorImpl&) = delete;
+        void run();
+        bool step();
+        void finish();
+        void onTransition(TransitionCallback callback) { transitionCallbacks.push_back(std::move(callback)); }
+        int time() const { return timer; }
+        const Metrics::Collector& metrics() const { return metricsCollector; }
+
+        bool verbose = true; //Whether progress is printed to the console
+
+    private:
+        Parsing::Options options; //what is being simulated
+        std::vector<pcb_t> pcbTable; //every process, the state lists point into it
+        StateQueue pcb[NUM_STATES]; //the processes in each state
+        Memory* memory = nullptr; //the main memory
+        int timer = 0; //Necessary for keeping track of the program time over multiple functions within execution
+        std::string outputDirectory; //where the output files go
+        Output::TraceWriter traceOutput; //writes both the execution and the memory status tables
+        std::string memoryState; //the partition state of the last memory status line, kept to reuse its memory
+        Output::GanttWriter ganttOutput; //writes the run and IO intervals
+        Profiling::Profile profile; //where the time goes, only filled in when built with SIM_PROFILE
+        Metrics::Collector metricsCollector; //works out the scheduling metrics from the state transitions
+        Policy policy; //orders the scheduling queues and sizes the bursts
+        bool eventDriven = false; //Whether the clock jumps straight to the next event instead of ticking
+        int memoryGeneration = 0; //Incremented every time a partition is reserved or freed
+        int retryGeneration = -1; //The memory generation seen by the last arrival check
+        pcb_t* nextArrival = nullptr; //The first process in NOT_ARRIVED that has not arrived, everything before it is blocked on memory
+        std::vector<int> arrivalTimes; //the arrival times of the processes from the first not arrived on, as a column for the arrival scan
+        size_t arrivalCursor = 0; //where the next arrival is in the arrival times
+        bool blockedReversed = false; //Whether the processes blocked on memory are due to be retried back to front
+        uint blockedMinSize = 0; //No process blocked on memory is smaller than this, so a retry that cannot fit it is skipped
+        std::priority_queue<Event, std::vector<Event>, std::greater<Event>> eventQueue; //pending events, earliest first
+        SchedulingQueue schedulingQueues[NUM_STATES]; //the order the NEW and READY processes are picked in
+        unsigned long nextTicket = 1; //the ticket handed to the next queued process
+        IoWaits ioWaits; //IO in progress
+        std::vector<IoCompletion> finishedIO; //the IO that finished on the last check, kept to reuse its memory
+        unsigned long nextIoSequence = 0; //the sequence number of the next process to start IO
+        std::vector<Core> cores; //the CPUs, only used when there is more than one
+        size_t nextCheckpoint = 0; //the next of the checkpoint times to write a snapshot at
+        bool restored = false; //whether the simulation carries on from a snapshot, so it has already started
+        bool started = false; //whether the processes arriving at the start have been loaded
+        bool stopped = false; //whether step has found nothing left to do
+        bool finished = false; //whether the output files have been ended
+        std::vector<TransitionCallback> transitionCallbacks; //told about every state transition
+        std::unique_ptr<Parsing::WorkloadStream> workloadStream; //where the processes come from when streaming, null once it has ended
+        std::deque<pcb_t> streamSlots; //the pcb table when streaming, only as big as the most processes alive at once
+        std::vector<pcb_t*> freeSlots; //the slots of retired processes, which are reused first
+
+        /**
+         * This function reserves the memory. by best fit
+         * @param size - the amount of memory needed
+         * @param process - what the partition is reserved for.
+         * @return - a boolean stating whether or not the memory was reserved.
+        */
+        bool reserveMemory(uint size, pcb_t* process);
+
+        /**
+         * This function frees the partition held by a process
+         * @param process - the process giving up its partition
+        */
+        void releaseMemory(pcb_t* process);
+
+        /**
+         * This function evaluates the memory and decides what processes to load into main memory. 
+         * It also is responsible for changing state from NOT_ARRIVED to NEW and NEW to ready.
+        */
+        void loadMemory();
+
+        /**
+         * This function moves a process between state lists without logging the transition.
+         * It also keeps the scheduling queues in step with the state lists.
+         * @param process - the process to move
+         * @param finalState - the state to move the process to
+         * @param toFront - whether to put the process at the front of its new list rather than the back
+        */
+        void moveProcess(pcb_t* process, ProcessState finalState, bool toFront = false);
+
+        /**
+         * This function is responsible for returning an execution order. It states what process should run and for how long.
+         * @param state - the state to pick a process from, NEW when loading memory and READY when executing
+         * @return an execution order.
+        */
+        ExecutionOrder getExecutionOrder(ProcessState state);
+
+        /**
+         * This function returns an execution order for the front of a scheduling queue
+         * @param queue - the queue to pick from
+         * @param waiting - the number of processes in the queue
+         * @return an execution order.
+        */
+        ExecutionOrder getExecutionOrder(SchedulingQueue& queue, size_t waiting);
+
+        /**
+         * This function checks whether the front of a ready queue should take the CPU from a running process
+         * @param queue - the ready queue the running process would go back to
+         * @param running - the running process
+         * @return true if the running process should be preempted
+        */
+        bool shouldPreempt(SchedulingQueue& queue, const pcb_t* running);
+
+        /**
+         * This function boosts every process and queues the ready ones again in the order they were in, if the policy
+         * is due a boost. It is called just before a process is picked from a ready queue, so the engines boost at the same times.
+        */
+        void boostPriorities();
+
+        /**
+         * This function adds a process to the scheduling queue of a state
+         * @param process - the process being queued
+         * @param state - the state the process entered
+        */
+        void queueProcess(pcb_t* process, ProcessState state);
+
+        /**
+         * This function removes a process from whatever scheduling queue it is in.
+         * @param process - the process leaving its state
+        */
+        void dequeueProcess(pcb_t* process);
+
+        /**
+         * This function returns the process at the front of a scheduling queue, discarding any stale entries.
+         * @param queue - the scheduling queue
+         * @return the foremost process, or nullptr if the queue is empty.
+        */
+        pcb_t* frontOf(SchedulingQueue& queue);
+
+        /**
+         * This function is responsible for returning true if there are still processes to run.
+         * @return true if there are processes to run, false otherwise.
+         */
+        bool processesRemain();
+
+        /**
+         * This method sets the output file for execution
+         * @param executionFileName - the name of the primary output file
+         * @param memoryStatusFileName - the name of the secondary output file
+         * @param background - whether the output is formatted and written on a background thread
+        */
+        void setOutputFiles(std::string executionFileName, std::string memoryStatusFileName, bool background);
+
+        /**
+         * This method returns the name of an output file of this simulation
+         * @param prefix - what the output is
+         * @param extension - the extension of the output file
+         * @return the path of the output file
+        */
+        std::string outputFilename(std::string prefix, std::string extension = ".txt");
+
+        /**
+         * This method writes the metrics files that were asked for
+        */
+        void writeMetrics();
+
+        /**
+         * This method writes the profile next to the tables, when built with SIM_PROFILE
+        */
+        void writeProfile();
+
+        /**
+         * This method writes a snapshot of the whole simulation
+         * @param fileName - the snapshot file
+        */
+        void saveCheckpoint(std::string fileName);
+
+        /**
+         * This method writes a scheduling queue to a snapshot, live entries only and in the order they come out
+         * @param snapshot - the snapshot being written
+         * @param queue - the queue
+        */
+        void saveQueue(Parsing::SnapshotWriter& snapshot, SchedulingQueue queue);
+
+        /**
+         * This method reads a scheduling queue back from a snapshot
+         * @param snapshot - the snapshot being read
+         * @param queue - the queue to fill
+         * @param state - the state the queue holds
+         * @param rekey - whether the keys have to be worked out again because the strategy changed
+        */
+        void restoreQueue(Parsing::SnapshotReader& snapshot, SchedulingQueue& queue, ProcessState state, bool rekey);
+
+        /**
+         * This method writes the headers of both output files
+        */
+        void writeHeaders();
+
+        /**
+         * This method writes the closing lines of both output files
+        */
+        void writeFooters();
+
+        /**
+         * This method writes the memory status to the output file
+         * @param memAllocated - the memory allocated
+        */
+        void writeMemoryStatus(int memAllocated);
+
+        /**
+         * This method writes the execution step to the output file
+         * @param process - the process to execute
+         * @param currentState - the current state of the process
+         * @param nextState - the next state of the process
+        */
+        void writeExecutionStep(pcb_t* process, ProcessState currentState ,ProcessState nextState);
+
+        /**
+         * This method is intended to do one execution cycle of a process.
+         * @return false if nothing can ever happen again (event driven mode only), true otherwise.
+        */
+        bool doExecution();
+
+        /**
+         * This method is one execution cycle when there are several CPUs. Idle CPUs take work first, then the clock
+         * runs until the next burst ends, or a single step while a CPU is idle.
+         * @return false if nothing can ever happen again (event driven mode only), true otherwise.
+        */
+        bool doMultiCoreExecution();
+
+        /**
+         * This method starts a burst on an idle CPU. The CPU runs the front of its own queue, or steals the front of
+         * the longest queue of another CPU when its own is empty. Ties go to the lowest CPU so runs are repeatable.
+         * @param core - the idle CPU
+        */
+        void dispatch(int core);
+
+        /**
+         * This method ends the burst running on a CPU
+         * @param core - the CPU
+        */
+        void finishBurst(int core);
+
+        /**
+         * This method sends the process running on a CPU back to the ready queue before its burst is over
+         * @param core - the CPU
+        */
+        void preempt(int core);
+
+        /**
+         * This method returns the CPU that a process that has never run is queued on
+         * @return the CPU with the fewest processes running or waiting, the lowest one on a tie
+        */
+        int leastLoadedCore();
+
+        /**
+         * This function adds an event to the event queue. It does nothing when ticking.
+         * @param time - the time the event happens at
+         * @param kind - what kind of event it is
+        */
+        void scheduleEvent(int time, EventKind kind);
+
+        /**
+         * This function returns the time of the next tick that has to be simulated in full.
+         * Events that are already in the past are discarded.
+         * @return the time of the next event, or -1 if there is none.
+        */
+        int nextEventTime();
+
+        /**
+         * This function checks whether processes that were blocked on memory need to be retried on the next arrival check.
+         * Retries only matter after the memory has changed, otherwise they just reverse the order of the blocked processes.
+         * @return true if the blocked processes must be retried.
+        */
+        bool retryPending();
+
+        /**
+         * This function sorts the processes that have not arrived by arrival time, keeping the input order for ties.
+         * It must be called once before the simulation starts.
+        */
+        void sortArrivals();
+
+        /**
+         * This function fills the arrival times with the next arrival and every process after it in NOT_ARRIVED.
+         * It is only needed when the list was not built by sortArrivals.
+        */
+        void indexArrivals();
+
+        /**
+         * This function reads the next process from the stream into a free slot and queues it in NOT_ARRIVED,
+         * where it becomes the next arrival. The stream is closed once it ends.
+        */
+        void streamProcess();
+
+        /**
+         * This method prints the pcb table and loads the processes arriving at the start, unless the simulation
+         * carries on from a snapshot
+        */
+        void start();
+
+        /**
+         * This function frees the slot of a terminated process so a streamed process can use it. It does nothing
+         * unless streaming, since the pcb table is kept whole otherwise.
+         * @param process - the terminated process
+        */
+        void retire(pcb_t* process);
+
+        /**
+         * This function puts a process that did not fit in memory back at the front of NOT_ARRIVED.
+         * @param process - the process that was blocked
+        */
+        void blockOnMemory(pcb_t* process);
+
+        /**
+         * This function applies any pending reversal of the processes blocked on memory.
+        */
+        void restoreBlockedOrder();
+
+        /**
+         * This function advances the timer by a single time unit.
+         * @param running - the running process, or nullptr if the CPU is idle
+        */
+        void tick(pcb_t* running);
+
+        /**
+         * This function advances the timer over ticks in which nothing can happen, without simulating them one by one.
+         * @param count - the number of ticks to skip
+         * @param running - the running process, or nullptr if the CPU is idle
+        */
+        void skipTicks(int count, pcb_t* running);
+
+        /**
+         * This function advances the timer up to the given time, either tick by tick or from event to event.
+         * With a preemptive policy it stops early if a process that became ready should take the CPU.
+         * @param target - the time to stop at
+         * @param running - the running process, or nullptr if the CPU is idle
+        */
+        void advanceClock(int target, pcb_t* running);
+
+        /**
+         * This function is responsible for changing the state of a process
+         * @param process - the process to change the state of
+         * @param initialState - the state the process is expected to be in
+         * @param finalState - the state to move the process to
+         * @return true if the state was changed, false if the process was not in the initial state.
+        */
+        bool changeState(pcb_t* process, ProcessState initialState, ProcessState finalState);
+
+        /**
+         * This function is responsible for doing checking if any processes have arrived
+         * if they have, move them to new state. Processes blocked on memory are retried first, but only
+         * if the memory has changed since they were last tried.
+        */
+        void checkArrived();
+
+        /**
+         * This function is responsible for checking if a process is done waiting
+         * if so, it changes to ready state. Only the processes whose IO is finishing are touched.
+        */
+        void doIO();
+
+        /**
+         * This function starts the IO of a process that has just moved to the waiting state
+         * @param process - the process doing IO
+        */
+        void startIO(pcb_t* process);
+    };
+};
+#endif
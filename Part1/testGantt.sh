@@ -19,7 +19,6 @@ fi
 
 #compile interrupts
 g++  interrupts.cpp -I interrupts.hpp -o sim
-./sim $filename $name
-#Run the gantt chart bullcrap
-python3 parseGantt.py $filename $name
+#The simulator writes the run intervals and draws the chart itself
+./sim $filename $name --gantt=html
 